@@ -0,0 +1,70 @@
+#!/bin/sh
+# usage: bench.sh [size...]
+#
+# Compiles programs made by bfgen of growing size with bfc1 -t and prints
+# time and peak memory growth of every phase.  Fails if time or memory grows
+# faster than size times GROWTH between two sizes, steps faster than MIN_TIME
+# seconds or smaller than MIN_MEMORY kilobytes are not checked.
+
+BFC1=${BFC1:-./bfc1}
+BFGEN=${BFGEN:-./bfgen}
+GROWTH=${GROWTH:-1.5}
+MIN_TIME=${MIN_TIME:-0.05}
+MIN_MEMORY=${MIN_MEMORY:-16384}
+
+[ $# -eq 0 ] && set -- 1K 10K 100K 1M 10M 100M
+
+tmp=$(mktemp -d) || exit 2
+trap 'rm -rf "$tmp"' EXIT INT TERM
+
+printf "%8s %-6s %9s %9s %9s %9s %9s %9s\n" \
+	size "" parse allocate optimize lower emit total
+
+for size in "$@"; do
+	"$BFGEN" -s "$size" > "$tmp/prog.bf" || exit 2
+	"$BFC1" "$tmp/prog.bf" "$tmp/prog.s" -t 2> "$tmp/times" || { cat "$tmp/times"; exit 2; }
+
+	awk -v size="$size" '
+		$2 == "time"   { sub(":", "", $3); sub("s", "", $4); t[$3] = $4 }
+		$2 == "memory" { sub(":", "", $3); sub("K", "", $4); m[$3] = $4 }
+		END {
+			printf "%8s %-6s %9.3f %9.3f %9.3f %9.3f %9.3f %9.3f\n", size, "time",
+				t["parse"], t["allocate"], t["optimize"], t["lower"], t["emit"], t["total"]
+			printf "%8s %-6s %8dK %8dK %8dK %8dK %8dK %8dK\n", "", "memory",
+				m["parse"], m["allocate"], m["optimize"], m["lower"], m["emit"], m["peak"]
+			printf "%d %s %s %s %s %s %s %s %s %s %s %s %s\n", size_bytes(size),
+				t["parse"], t["allocate"], t["optimize"], t["lower"], t["emit"], t["total"],
+				m["parse"], m["allocate"], m["optimize"], m["lower"], m["emit"], m["peak"] > "/dev/stderr"
+		}
+		function size_bytes(s,    n, unit) {
+			n = s + 0
+			unit = substr(s, length(s))
+			if (unit == "K") n *= 1024
+			if (unit == "M") n *= 1024 * 1024
+			if (unit == "G") n *= 1024 * 1024 * 1024
+			return n
+		}
+	' "$tmp/times" 2>> "$tmp/results"
+done
+
+awk -v growth="$GROWTH" -v min_time="$MIN_TIME" -v min_memory="$MIN_MEMORY" '
+	BEGIN { split("size parse allocate optimize lower emit total", name) }
+	NR > 1 {
+		limit = $1 / prev[1] * growth
+
+		for (i = 2; i <= 7; i++) {
+			if (prev[i] >= min_time && $i > prev[i] * limit) {
+				printf "bench: %s time grows %.1fx from %d to %d bytes\n", name[i], $i / prev[i], prev[1], $1
+				fail = 1
+			}
+
+			if (prev[i + 6] >= min_memory && $(i + 6) > prev[i + 6] * limit) {
+				printf "bench: %s memory grows %.1fx from %d to %d bytes\n", name[i],
+					$(i + 6) / prev[i + 6], prev[1], $1
+				fail = 1
+			}
+		}
+	}
+	{ for (i = 1; i <= 13; i++) prev[i] = $i }
+	END { exit fail }
+' "$tmp/results"
@@ -14,18 +14,28 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdbool.h>
+#include <string.h>
+#include <stdint.h>
 #include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
-#define SMALL_USAGE "usage: [file][-o out file][-S][-c][-v][-C bc1 path][-a as path][-l ld path][-h]\n"
+#define SMALL_USAGE "usage: [file][-o out file][-S][-c][-s][-v][-f flag][-j jobs][-e emit][-C bc1 path][-a as path][-l ld path][-x cc path][-D socket][-h]\n"
 #define USAGE \
 	"    [file]         source code file\n" \
 	"    [-o out file]  output file name, default is a.out\n" \
 	"    [-S]           generate assembly code\n" \
 	"    [-c]           generate not linked object file\n" \
+	"    [-s]           generate shared object with bf_run function\n" \
 	"    [-v]           show running commands\n" \
+	"    [-f flag]      code generation flag, passed to real compiler\n" \
+	"    [-j jobs]      compile top-level loops of large programs on jobs threads\n" \
+	"    [-e emit]      output of real compiler: asm, c, llvm or ir, default is asm\n" \
 	"    [-C]           path to real compiler\n" \
 	"    [-a]           path to assembler\n" \
 	"    [-l]           path to linker\n" \
+	"    [-x]           path to c compiler for c and llvm output\n" \
+	"    [-D socket]    compile with resident bfc1 --serve listening on socket\n" \
 	"    [-h]           print this menu\n"
 
 static void usage(bool small, FILE* stream)
@@ -37,6 +47,127 @@ static void usage(bool small, FILE* stream)
 #define DEFAULT_BC1_PATH "bfc1"
 #define DEFAULT_AS_PATH "as"
 #define DEFAULT_LD_PATH "ld"
+#define DEFAULT_CC_PATH "cc"
+#define DEFAULT_CLANG_PATH "clang"
+
+#define MAX_BC1_FLAGS 1024
+#define EMBED_FLAG " -fembed"
+#define MAX_REMOTE_ARGS_SIZE 4096
+
+static bool read_full(int fd, void* buf, size_t size)
+{
+	for (size_t done = 0; done < size;) {
+		ssize_t n = read(fd, (char*) buf + done, size - done);
+		if (n <= 0)
+			return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+static bool write_full(int fd, const void* buf, size_t size)
+{
+	for (size_t done = 0; done < size;) {
+		ssize_t n = write(fd, (const char*) buf + done, size - done);
+		if (n <= 0)
+			return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+static bool copy_stream(int fd, FILE* stream)
+{
+	uint64_t size;
+	char buf[4096];
+
+	if (!read_full(fd, &size, sizeof(size)))
+		return false;
+
+	while (size > 0) {
+		size_t n = size < sizeof(buf) ? size : sizeof(buf);
+		if (!read_full(fd, buf, n) || (stream != NULL && fwrite(buf, 1, n, stream) != n))
+			return false;
+
+		size -= n;
+	}
+
+	return true;
+}
+
+static bool compile_remote(const char* socket_path, const char* in_file, const char* out_file,
+		const char* emit, const char* flags)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+	char args[MAX_REMOTE_ARGS_SIZE];
+	uint32_t args_size = 0;
+	uint32_t status = 1;
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+		return false;
+
+	strcpy(addr.sun_path, socket_path);
+
+	args_size += sprintf(args, "-e%s", emit) + 1;
+	for (const char* p = flags; *p != '\0'; p++) {
+		if (*p == ' ')
+			continue;
+
+		size_t len = strcspn(p, " ");
+		memcpy(args + args_size, p, len);
+		args_size += len;
+		args[args_size++] = '\0';
+		p += len - 1;
+	}
+
+	FILE* in = fopen(in_file, "r");
+	if (in == NULL)
+		return false;
+
+	fseek(in, 0, SEEK_END);
+	uint64_t src_size = ftell(in);
+	rewind(in);
+
+	char* src = malloc(src_size);
+	if (src == NULL || fread(src, 1, src_size, in) != src_size) {
+		free(src);
+		fclose(in);
+		return false;
+	}
+
+	fclose(in);
+
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd < 0 || connect(fd, (struct sockaddr*) &addr, sizeof(addr)) < 0) {
+		fprintf(stderr, "bc: can't connect to %s\n", socket_path);
+		if (fd >= 0)
+			close(fd);
+
+		free(src);
+		return false;
+	}
+
+	bool ok = write_full(fd, &args_size, sizeof(args_size)) && write_full(fd, args, args_size) &&
+		write_full(fd, &src_size, sizeof(src_size)) && write_full(fd, src, src_size) &&
+		read_full(fd, &status, sizeof(status)) && copy_stream(fd, stderr);
+
+	free(src);
+
+	if (ok && status == 0) {
+		FILE* out = fopen(out_file, "w");
+		ok = out != NULL && copy_stream(fd, out);
+		if (out != NULL)
+			fclose(out);
+	}
+
+	close(fd);
+
+	return ok && status == 0;
+}
 
 int main(int argc, char* argv[])
 {
@@ -46,10 +177,16 @@ int main(int argc, char* argv[])
 	const char* bc1_path = DEFAULT_BC1_PATH;
 	const char* as_path  = DEFAULT_AS_PATH;
 	const char* ld_path  = DEFAULT_LD_PATH;
+	const char* cc_path  = NULL;
+	const char* emit     = "asm";
+	const char* server   = NULL;
 
 	bool no_link = false;
 	bool no_as   = false;
 	bool verbose = false;
+	bool shared  = false;
+
+	char bc1_flags[MAX_BC1_FLAGS] = "";
 
 	if (argc < 2) {
 		usage(true, stderr);
@@ -59,15 +196,53 @@ int main(int argc, char* argv[])
 	in_file = argv[1];
 
 	int c;
-	while ((c = getopt(argc, argv, "o:ScvC:a:l:h")) != -1) switch (c) {
+	while ((c = getopt(argc, argv, "o:Scsvf:j:e:C:a:l:x:D:h")) != -1) switch (c) {
 	case 'o':
 		out_file = optarg;
 		break;
 
+	case 'f':
+		if (strlen(bc1_flags) + strlen(optarg) + 4 + sizeof(EMBED_FLAG) > MAX_BC1_FLAGS) {
+			usage(true, stderr);
+			exit(1);
+		}
+
+		strcat(bc1_flags, " -f");
+		strcat(bc1_flags, optarg);
+		break;
+
+	case 'j':
+		if (strlen(bc1_flags) + strlen(optarg) + 4 + sizeof(EMBED_FLAG) > MAX_BC1_FLAGS) {
+			usage(true, stderr);
+			exit(1);
+		}
+
+		strcat(bc1_flags, " -j ");
+		strcat(bc1_flags, optarg);
+		break;
+
+	case 'e':
+		if (strcmp(optarg, "asm") != 0 && strcmp(optarg, "c") != 0 && strcmp(optarg, "llvm") != 0 &&
+				strcmp(optarg, "ir") != 0) {
+			usage(true, stderr);
+			exit(1);
+		}
+
+		emit = optarg;
+		break;
+
 	case 'C':
 		bc1_path = optarg;
 		break;
 
+	case 'x':
+		cc_path = optarg;
+		break;
+
+	case 'D':
+		server = optarg;
+		break;
+
 	case 'a':
 		as_path = optarg;
 		break;
@@ -83,6 +258,10 @@ int main(int argc, char* argv[])
 		no_link = true;
 		break;
 
+	case 's':
+		shared = true;
+		break;
+
 	case 'v':
 		verbose = true;
 		break;
@@ -96,17 +275,52 @@ int main(int argc, char* argv[])
 		exit(1);
 	}
 
-	FILE* sh = popen("sh", "w");
+	if (shared)
+		strcat(bc1_flags, EMBED_FLAG);
+
+	if (strcmp(emit, "ir") == 0)
+		no_as = true;
 
 	char temp_s_buf[] = "/tmp/bc.XXXXXX.s";
 	const char* temp_s = tmpnam(temp_s_buf);
-	fprintf(sh, "%s %s %s\n", bc1_path, in_file, no_as ? out_file : temp_s);
-	if (verbose)
-		fprintf(stdout, "%s %s %s\n", bc1_path, in_file, no_as ? out_file : temp_s);
+
+	if (server != NULL) {
+		if (verbose)
+			fprintf(stdout, "remote %s %s %s -e %s%s\n", server, in_file, no_as ? out_file : temp_s,
+					emit, bc1_flags);
+
+		if (!compile_remote(server, in_file, no_as ? out_file : temp_s, emit, bc1_flags))
+			return 3;
+	}
+
+	FILE* sh = popen("sh", "w");
+
+	if (server == NULL) {
+		fprintf(sh, "%s %s %s -e %s%s\n", bc1_path, in_file, no_as ? out_file : temp_s, emit,
+				bc1_flags);
+		if (verbose)
+			fprintf(stdout, "%s %s %s -e %s%s\n", bc1_path, in_file, no_as ? out_file : temp_s,
+					emit, bc1_flags);
+	}
 
 	if (no_as)
 		goto done;
 
+	if (strcmp(emit, "asm") != 0) {
+		bool is_c = strcmp(emit, "c") == 0;
+
+		if (cc_path == NULL)
+			cc_path = is_c ? DEFAULT_CC_PATH : DEFAULT_CLANG_PATH;
+
+		fprintf(sh, "%s -O3 -x %s %s%s -o %s\n", cc_path, is_c ? "c" : "ir", temp_s,
+				no_link ? " -c" : "", out_file);
+		if (verbose)
+			fprintf(stdout, "%s -O3 -x %s %s%s -o %s\n", cc_path, is_c ? "c" : "ir", temp_s,
+					no_link ? " -c" : "", out_file);
+
+		goto done;
+	}
+
 	char temp_o_buf[] = "/tmp/bc.XXXXXX.o";
 	const char* temp_o = tmpnam(temp_o_buf);
 	fprintf(sh, "%s %s -o %s\n", as_path, temp_s, no_link ? out_file : temp_o);
@@ -116,9 +330,9 @@ int main(int argc, char* argv[])
 	if (no_link)
 		goto done;
 
-	fprintf(sh, "%s %s -o %s\n", ld_path, temp_o, out_file);
+	fprintf(sh, "%s%s %s -o %s\n", ld_path, shared ? " -shared" : "", temp_o, out_file);
 	if (verbose)
-		fprintf(stdout, "%s %s -o %s\n", ld_path, temp_o, out_file);
+		fprintf(stdout, "%s%s %s -o %s\n", ld_path, shared ? " -shared" : "", temp_o, out_file);
 
 done:
 	pclose(sh);
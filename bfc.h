@@ -0,0 +1,33 @@
+/*
+	Permission to use, copy, modify, and/or distribute this software for
+	any purpose with or without fee is hereby granted.
+
+	THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL
+	WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES
+	OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE
+	FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY
+	DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+	AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+	OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef BFC_H
+#define BFC_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+struct bfc_ctx;
+
+/* creates context for one program, diagnostics are written to err */
+struct bfc_ctx* bfc_create(FILE* err);
+void bfc_destroy(struct bfc_ctx* ctx);
+
+/* sets bfc1 option, e.g. ('f', "cell=32") or ('e', "llvm") */
+bool bfc_set_option(struct bfc_ctx* ctx, char option, const char* value);
+
+/* compiles len bytes of src to out, returns 0 on success */
+int bfc_compile(struct bfc_ctx* ctx, const char* src, size_t len, FILE* out);
+
+#endif
@@ -12,22 +12,63 @@
 */
 
 #include <stdlib.h>
+#include <stdarg.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <stdbool.h>
 #include <string.h>
+#include <limits.h>
+#include <setjmp.h>
+#include <time.h>
+#include <unistd.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "bfc.h"
 
 #define array_lenght(x) sizeof(x) / sizeof(x[0])
 
-#define MAX_PROG_SIZE 1024 * 32
-#define MAX_VARS 1024 * 2
-#define MAX_CMDS 1024 * 16
-#define MAX_LABEL_NAME 32
-#define MAX_LABELS 1024
-#define MAX_CONST_STR 128
+#define VAR_BLOCK_SIZE 1024
+#define MAX_LABEL_NAME 48
+#define LABEL_BLOCK_SIZE 256
+#define MAX_CONST_STR 64
 #define MAX_LEVEL_COUNT 128
 #define MAX_PASS 512
+#define MAX_PEEPHOLE_WINDOW 8
+#define MAX_PEEPHOLE_RULES 16
+#define MAX_VEC_BYTES 64
+#define MIN_VEC_CELLS 4
+#define MAX_UNROLL_CMDS 512
+#define MAX_PARTIAL_UNROLL 8
+#define PAGE_SIZE 4096
+#define DEFAULT_TAPE_SIZE 1024 * 1024
+#define MAX_REQUEST_ARGS 64
+#define MAX_JOBS 256
+#define MIN_REGION_SIZE 1024 * 16
+#define MIN_CUT_REGION_SIZE 1024
+#define REGION_CUT_MASK 15
+#define HASH_SEED 0xcbf29ce484222325
+#define HASH_PRIME 0x100000001b3
+#define CACHE_VERSION 1
+
+#ifndef BFC_BUILD_ID
+#define BFC_BUILD_ID __DATE__ " " __TIME__
+#endif
+
+#define MAX_LABEL_SUFFIX 24
+#define MAX_REQUEST_ARGS_SIZE 4096
+#define MAX_REQUEST_SIZE 1024 * 1024 * 1024
+#define REQUEST_TIMEOUT 10
+#define IR_MAGIC "BFIR"
+#define IR_VERSION 1
 
 enum var_type {
 	VAR_PROG = 0,
@@ -36,7 +77,10 @@ enum var_type {
 	VAR_REGISTER,
 
 	VAR_CONST,
+	VAR_CONST_QWORD,
 	VAR_CONST_STR,
+	VAR_CONST_VEC,
+	VAR_MEM,
 
 	VAR_LABEL,
 };
@@ -51,6 +95,10 @@ enum cmd_size {
 enum reg {
 	REG_AH = 0,
 	REG_AL,
+	REG_AX,
+	REG_EAX,
+	REG_DX,
+	REG_EDX,
 	REG_CH,
 	REG_CL,
 	REG_DH,
@@ -64,6 +112,19 @@ enum reg {
 	REG_RDX,
 	REG_RBP,
 	REG_RSP,
+	REG_R8,
+	REG_R9,
+	REG_R10,
+	REG_R12,
+	REG_R13,
+	REG_R14,
+	REG_R15,
+	REG_RBX,
+	REG_RCX,
+
+	REG_XMM0,
+	REG_YMM0,
+	REG_ZMM0,
 };
 
 struct var {
@@ -72,9 +133,12 @@ struct var {
 	union {
 		enum reg reg;
 		size_t stack_offset;
-		uint32_t value;
+		uint64_t value;
+		uint64_t value64;
 		char str[MAX_CONST_STR];
 	} value;
+
+	size_t id;
 };
 
 struct var_lifetime {
@@ -86,6 +150,7 @@ enum cmd_type {
 	CMD_ADD = 0,
 	CMD_SUB,
 	CMD_XOR,
+	CMD_IMUL,
 	CMD_SYSCALL,
 	CMD_LABEL,
 	CMD_MOV,
@@ -93,9 +158,15 @@ enum cmd_type {
 	CMD_JE,
 	CMD_JNE,
 	CMD_JMP,
+	CMD_JA,
+	CMD_JB,
+	CMD_RET,
 	CMD_LEA,
 	CMD_PUSH,
 	CMD_POP,
+	CMD_MOVDQU,
+	CMD_PAND,
+	CMD_PADD,
 	CMD_EMPTY,
 };
 
@@ -116,54 +187,417 @@ enum label_type {
 struct label {
 	enum label_type type;
 	char name[MAX_LABEL_NAME];
+
+	struct var* cell;
+	size_t id;
+};
+
+struct bfc_ctx;
+
+typedef bool (*pass_f)(struct bfc_ctx* ctx, struct cmd* cmd);
+typedef bool (*global_pass_f)(struct bfc_ctx* ctx);
+
+enum backend {
+	BACKEND_ASM = 0,
+	BACKEND_C,
+	BACKEND_LLVM,
+	BACKEND_IR,
+};
+
+enum march {
+	MARCH_BASELINE = 0,
+	MARCH_SSE42,
+	MARCH_AVX2,
+	MARCH_AVX512,
+	MARCH_FAT,
+};
+
+static const char* march_names[] = { "baseline", "sse4.2", "avx2", "avx512", "fat" };
+static const enum march fat_variants[] = { MARCH_BASELINE, MARCH_AVX2, MARCH_AVX512 };
+
+enum phase {
+	PHASE_PARSE = 0,
+	PHASE_ALLOCATE,
+	PHASE_OPTIMIZE,
+	PHASE_LOWER,
+	PHASE_EMIT,
+	PHASE_COUNT,
+};
+
+static const char* phase_names[] = { "parse", "allocate", "optimize", "lower", "emit" };
+
+enum cell_fact {
+	FACT_UNKNOWN = 0,
+	FACT_CONST,
+	FACT_NONZERO,
+};
+
+struct cell_state {
+	enum cell_fact fact;
+	uint64_t value;
 };
 
-typedef bool (*pass_f)(struct cmd* cmd);
+struct var_block {
+	struct var vars[VAR_BLOCK_SIZE];
+	struct var_block* next;
+};
+
+struct label_block {
+	struct label labels[LABEL_BLOCK_SIZE];
+	struct label_block* next;
+};
+
+struct deferred_region {
+	size_t start;
+	size_t end;
+	size_t offset;
+	size_t count;
+};
+
+struct region {
+	size_t start;
+	size_t len;
+	size_t entry_cell;
+	uint64_t key;
+
+	int status;
+	char* out_buf;
+	size_t out_size;
+	char* err_buf;
+	size_t err_size;
+};
+
+struct bfc_ctx {
+	enum backend backend;
+	enum cmd_size cell_size;
+	size_t tape_size;
+	bool use_huge_pages;
+	bool embed;
+	bool use_vec;
+	enum march march;
+	bool show_stats;
+	bool show_times;
+	size_t jobs;
+	char* cache_dir;
+
+	bool is_region;
+	bool has_prolouge;
+	bool has_epiloge;
+	char label_suffix[MAX_LABEL_SUFFIX];
+	char variant_suffix[MAX_LABEL_SUFFIX];
+
+	struct region* regions;
+	size_t region_count;
+
+	FILE* err;
+	jmp_buf error;
+
+	struct var* bf_vars;
+	size_t cell_count;
+	struct var_block* var_blocks;
+	size_t var_count;
+
+	struct var** consts;
+	size_t const_capacity;
+	size_t const_count;
+
+	struct cmd* cmds;
+	size_t cmd_count;
+	size_t cmd_capacity;
+
+	struct label_block* label_blocks;
+	size_t label_count;
+
+	pass_f passes[MAX_PASS];
+	size_t pass_count;
+
+	global_pass_f global_passes[MAX_PASS];
+	size_t global_pass_count;
+
+	struct var* var_stdout;
+	struct var* var_stdin;
+	struct var* zero_var;
+
+	size_t level;
+	size_t level_reparts[MAX_LEVEL_COUNT];
+	struct var* level_cells[MAX_LEVEL_COUNT];
+	size_t crnt_var;
+
+	size_t embed_input_count;
+	size_t const_str_num;
+	size_t llvm_tmp;
+
+	struct cell_state* cell_states;
+	bool* is_read;
+	struct cmd region_buf[MAX_UNROLL_CMDS];
+	struct cmd* scratch_cmds;
+	size_t scratch_capacity;
+
+	struct deferred_region* deferred;
+	size_t deferred_count;
+	size_t deferred_capacity;
+	struct cmd* deferred_cmds;
+	size_t deferred_cmd_count;
+	size_t deferred_cmd_capacity;
+
+	size_t peephole_hits[MAX_PEEPHOLE_RULES];
+	size_t removed_loops;
+	size_t rotated_loops;
+	size_t removed_stores;
+	size_t counted_loops;
+	size_t unrolled_loops;
+	size_t partially_unrolled_loops;
+	size_t cache_hits;
+	size_t cache_misses;
+	double phase_times[PHASE_COUNT];
+	long phase_memory[PHASE_COUNT];
+	long memory_mark;
+
+	struct var** ir_vars;
+	struct label** ir_labels;
+	size_t* data_nums;
+};
+
+static void compile_error(struct bfc_ctx* ctx, const char* format, ...)
+{
+	va_list args;
+
+	va_start(args, format);
+	fprintf(ctx->err, "bfc1: ");
+	vfprintf(ctx->err, format, args);
+	fputc('\n', ctx->err);
+	va_end(args);
+
+	longjmp(ctx->error, 1);
+}
+
+static double now(void)
+{
+	struct timespec time;
+
+	clock_gettime(CLOCK_MONOTONIC, &time);
+	return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+static long peak_memory(void)
+{
+	struct rusage usage;
+
+	return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+static double end_phase(struct bfc_ctx* ctx, enum phase phase, double start)
+{
+	double end  = now();
+	long memory = peak_memory();
+
+	ctx->phase_times[phase]  += end - start;
+	ctx->phase_memory[phase] += memory - ctx->memory_mark;
+	ctx->memory_mark          = memory;
+
+	return end;
+}
+
+static size_t cell_bytes(struct bfc_ctx* ctx)
+{
+	return (size_t) 1 << ctx->cell_size;
+}
+
+static size_t vec_bytes(struct bfc_ctx* ctx)
+{
+	switch (ctx->march) {
+	case MARCH_AVX2:   return 32;
+	case MARCH_AVX512: return 64;
+	default:           return 16;
+	}
+}
+
+static enum reg vec_reg(struct bfc_ctx* ctx)
+{
+	switch (ctx->march) {
+	case MARCH_AVX2:   return REG_YMM0;
+	case MARCH_AVX512: return REG_ZMM0;
+	default:           return REG_XMM0;
+	}
+}
+
+static uint64_t wrap_value(int64_t value, enum cmd_size size)
+{
+	switch (size) {
+	case CMD_BYTE:  return (uint8_t) value;
+	case CMD_WORD:  return (uint16_t) value;
+	case CMD_DWORD: return (uint32_t) value;
+	default:        return (uint64_t) value;
+	}
+}
+
+static bool fits_imm_size(enum cmd_size size, uint64_t value)
+{
+	return size != CMD_QWORD || (int64_t) value == (int32_t) value;
+}
+
+static int64_t const_value(struct var* var)
+{
+	return var->value.value > UINT32_MAX ? (int64_t) var->value.value : (int32_t) var->value.value;
+}
+
+static bool is_cell(struct bfc_ctx* ctx, struct var* var)
+{
+	return var >= ctx->bf_vars && var < ctx->bf_vars + ctx->cell_count;
+}
+
+static size_t cell_index(struct bfc_ctx* ctx, struct var* var)
+{
+	return var - ctx->bf_vars;
+}
+
+static enum reg cell_reg(struct bfc_ctx* ctx)
+{
+	switch (ctx->cell_size) {
+	case CMD_WORD:  return REG_AX;
+	case CMD_DWORD: return REG_EAX;
+	case CMD_QWORD: return REG_RAX;
+	default:        return REG_AH;
+	}
+}
+
+static void reserve_cmds(struct bfc_ctx* ctx, size_t count)
+{
+	if (ctx->cmd_count + count <= ctx->cmd_capacity)
+		return;
+
+	size_t capacity = ctx->cmd_capacity == 0 ? 1024 : ctx->cmd_capacity;
+	while (capacity < ctx->cmd_count + count)
+		capacity *= 2;
+
+	struct cmd* cmds = realloc(ctx->cmds, capacity * sizeof(struct cmd));
+	if (cmds == NULL)
+		compile_error(ctx, "out of memory");
+
+	ctx->cmds         = cmds;
+	ctx->cmd_capacity = capacity;
+}
+
+static struct cmd* reserve_scratch(struct bfc_ctx* ctx, size_t count)
+{
+	if (count <= ctx->scratch_capacity)
+		return ctx->scratch_cmds;
+
+	struct cmd* cmds = realloc(ctx->scratch_cmds, count * sizeof(struct cmd));
+	if (cmds == NULL)
+		compile_error(ctx, "out of memory");
+
+	ctx->scratch_cmds     = cmds;
+	ctx->scratch_capacity = count;
+
+	return cmds;
+}
+
+static struct cmd* add_cmd(struct bfc_ctx* ctx, struct cmd* cmd)
+{
+	reserve_cmds(ctx, 1);
+
+	ctx->cmds[ctx->cmd_count++] = *cmd;
+	return &ctx->cmds[ctx->cmd_count - 1];
+}
+
+static struct label* add_label(struct bfc_ctx* ctx, struct label* label)
+{
+	if (ctx->label_count % LABEL_BLOCK_SIZE == 0) {
+		struct label_block* block = malloc(sizeof(struct label_block));
+		if (block == NULL)
+			compile_error(ctx, "out of memory");
+
+		block->next       = ctx->label_blocks;
+		ctx->label_blocks = block;
+	}
 
-static struct var bf_vars[MAX_VARS];
-static struct var vars[MAX_VARS];
-static size_t var_count = 0;
+	struct label* new_label = &ctx->label_blocks->labels[ctx->label_count % LABEL_BLOCK_SIZE];
+	*new_label    = *label;
+	new_label->id = ctx->label_count++;
 
-static struct cmd cmds[MAX_CMDS];
-static size_t cmd_count = 0;
+	return new_label;
+}
 
-static struct label labels[MAX_LABELS];
-static size_t label_count = 0;
+static struct var** find_const(struct bfc_ctx* ctx, uint64_t value)
+{
+	size_t mask = ctx->const_capacity - 1;
+	size_t i    = (value * 0x9e3779b97f4a7c15u >> 32) & mask;
 
-static pass_f passes[MAX_PASS];
-static size_t pass_count = 0;
+	while (ctx->consts[i] != NULL && ctx->consts[i]->value.value != value)
+		i = (i + 1) & mask;
 
-static struct var* var_stdout;
-static struct var* var_stdin;
+	return &ctx->consts[i];
+}
 
-static struct cmd* add_cmd(struct cmd* cmd)
+static void grow_consts(struct bfc_ctx* ctx)
 {
-	cmds[cmd_count++] = *cmd;
-	return &cmds[cmd_count - 1];
+	struct var** old    = ctx->consts;
+	size_t old_capacity = ctx->const_capacity;
+
+	ctx->const_capacity = old_capacity == 0 ? 256 : old_capacity * 2;
+	ctx->consts         = calloc(ctx->const_capacity, sizeof(struct var*));
+	if (ctx->consts == NULL)
+		compile_error(ctx, "out of memory");
+
+	for (size_t i = 0; i < old_capacity; i++) {
+		if (old[i] != NULL)
+			*find_const(ctx, old[i]->value.value) = old[i];
+	}
+
+	free(old);
 }
 
-static struct label* add_label(struct label* label)
+static struct var* add_var(struct bfc_ctx* ctx, struct var* var)
 {
-	labels[label_count++] = *label;
-	return &labels[label_count - 1];
+	struct var** slot = NULL;
+
+	if (var->type == VAR_CONST) {
+		if (ctx->const_count * 2 >= ctx->const_capacity)
+			grow_consts(ctx);
+
+		slot = find_const(ctx, var->value.value);
+		if (*slot != NULL)
+			return *slot;
+	}
+
+	if (ctx->var_count % VAR_BLOCK_SIZE == 0) {
+		struct var_block* block = malloc(sizeof(struct var_block));
+		if (block == NULL)
+			compile_error(ctx, "out of memory");
+
+		block->next     = ctx->var_blocks;
+		ctx->var_blocks = block;
+	}
+
+	struct var* new_var = &ctx->var_blocks->vars[ctx->var_count % VAR_BLOCK_SIZE];
+	*new_var    = *var;
+	new_var->id = ctx->var_count++;
+
+	if (slot != NULL) {
+		*slot = new_var;
+		ctx->const_count++;
+	}
+
+	return new_var;
 }
 
-static struct var* add_var(struct var* var)
+static void add_pass(struct bfc_ctx* ctx, pass_f pass)
 {
-	vars[var_count++] = *var;
-	return &vars[var_count - 1];
+	ctx->passes[ctx->pass_count++] = pass;
 }
 
-static void add_pass(pass_f pass)
+static void add_global_pass(struct bfc_ctx* ctx, global_pass_f pass)
 {
-	passes[pass_count++] = pass;
+	ctx->global_passes[ctx->global_pass_count++] = pass;
 }
 
-static void compile_syscall(struct var* num, struct var* arg0, struct var* arg1, struct var* arg2)
+static void compile_syscall(struct bfc_ctx* ctx, struct var* num, struct var* arg0, struct var* arg1,
+		struct var* arg2)
 {
 #	define move_to_reg(x, y) \
-		add_cmd(&(struct cmd) { .type = CMD_MOV, .arg0 = x, .size = CMD_QWORD,  \
-				.arg1 = add_var(&(struct var) { .type = VAR_REGISTER, .value.reg = y })});
+		add_cmd(ctx, &(struct cmd) { .type = CMD_MOV, .arg0 = x, .size = CMD_QWORD,  \
+				.arg1 = add_var(ctx, &(struct var) { .type = VAR_REGISTER, .value.reg = y })});
 
 	move_to_reg(num, REG_RAX);
 	if (arg0 != NULL) move_to_reg(arg0, REG_RDI);
@@ -172,197 +606,382 @@ static void compile_syscall(struct var* num, struct var* arg0, struct var* arg1,
 
 #	undef move_to_reg
 
-	add_cmd(&(struct cmd) { .type = CMD_SYSCALL });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_SYSCALL });
+}
+
+static void clear_var(struct bfc_ctx* ctx, struct var* var)
+{
+	struct var* zero = add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 0 });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_MOV, .size = ctx->cell_size, .arg0 = zero, .arg1 = var });
+}
+
+static struct var* add_const(struct bfc_ctx* ctx, int64_t value)
+{
+	return add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = value });
+}
+
+static struct var* add_reg(struct bfc_ctx* ctx, enum reg reg)
+{
+	return add_var(ctx, &(struct var) { .type = VAR_REGISTER, .value.reg = reg });
+}
+
+static void generate_tape(struct bfc_ctx* ctx)
+{
+	struct var* mmap_size = add_var(ctx, &(struct var) { .type = VAR_CONST_QWORD,
+			.value.value64 = (uint64_t) ctx->tape_size + 2 * PAGE_SIZE });
+	struct var* size      = add_var(ctx, &(struct var) { .type = VAR_CONST_QWORD,
+			.value.value64 = ctx->tape_size });
+	struct var* error     = add_var(ctx, &(struct var) { .type = VAR_LABEL, .value.str = "tape_error" });
+
+	add_cmd(ctx, &(struct cmd) { .type = CMD_MOV, .size = CMD_QWORD,
+			.arg0 = add_const(ctx, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE), .arg1 = add_reg(ctx, REG_R10) });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_MOV, .size = CMD_QWORD, .arg0 = add_const(ctx, -1),
+			.arg1 = add_reg(ctx, REG_R8) });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_MOV, .size = CMD_QWORD, .arg0 = add_const(ctx, 0),
+			.arg1 = add_reg(ctx, REG_R9) });
+	compile_syscall(ctx, add_const(ctx, 9), add_const(ctx, 0), mmap_size, add_const(ctx, PROT_NONE));
+
+	add_cmd(ctx, &(struct cmd) { .type = CMD_CMP, .size = CMD_QWORD, .arg0 = add_const(ctx, -PAGE_SIZE),
+			.arg1 = add_reg(ctx, REG_RAX) });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_JA, .arg0 = error });
+
+	add_cmd(ctx, &(struct cmd) { .type = CMD_MOV, .size = CMD_QWORD, .arg0 = add_reg(ctx, REG_RAX),
+			.arg1 = add_reg(ctx, REG_RBP) });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_ADD, .size = CMD_QWORD, .arg0 = add_const(ctx, PAGE_SIZE),
+			.arg1 = add_reg(ctx, REG_RBP) });
+
+	compile_syscall(ctx, add_const(ctx, 10), add_reg(ctx, REG_RBP), size,
+			add_const(ctx, PROT_READ | PROT_WRITE));
+	add_cmd(ctx, &(struct cmd) { .type = CMD_CMP, .size = CMD_QWORD, .arg0 = add_const(ctx, 0),
+			.arg1 = add_reg(ctx, REG_RAX) });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_JNE, .arg0 = error });
+
+	if (ctx->use_huge_pages)
+		compile_syscall(ctx, add_const(ctx, 28), add_reg(ctx, REG_RBP), size, add_const(ctx, MADV_HUGEPAGE));
+}
+
+static void add_op(struct bfc_ctx* ctx, enum cmd_type type, enum cmd_size size, struct var* arg0,
+		struct var* arg1)
+{
+	add_cmd(ctx, &(struct cmd) { .type = type, .size = size, .arg0 = arg0, .arg1 = arg1 });
+}
+
+static struct var* add_label_var(struct bfc_ctx* ctx, const char* name)
+{
+	struct var* var = add_var(ctx, &(struct var) { .type = VAR_LABEL });
+	strcpy(var->value.str, name);
+
+	return var;
 }
 
-static void clear_var(struct var* var)
+static void add_label_cmd(struct bfc_ctx* ctx, enum label_type type, const char* name)
 {
-	struct var* zero_var = add_var(&(struct var) { .type = VAR_CONST, .value.value = 0 });
-	add_cmd(&(struct cmd) { .type = CMD_MOV, .size = CMD_BYTE, .arg0 = zero_var, .arg1 = var });
+	struct label* label = add_label(ctx, &(struct label) { .type = type });
+	strcpy(label->name, name);
+
+	add_cmd(ctx, &(struct cmd) { .type = CMD_LABEL, .label = label });
 }
 
-static void generate_prolouge(void)
+static const enum reg embed_saved_regs[] = { REG_RBP, REG_RBX, REG_R12, REG_R13, REG_R14, REG_R15 };
+
+static void generate_embed_prolouge(struct bfc_ctx* ctx)
 {
-	add_cmd(&(struct cmd) { .type = CMD_LABEL, .arg0 = NULL, .arg1 = NULL,
-			.label = add_label(&(struct label) { .type = LABEL_GLOBL, .name = "_start" })});
+	add_label_cmd(ctx, LABEL_GLOBL, "bf_run");
+
+	for (size_t i = 0; i < array_lenght(embed_saved_regs); i++)
+		add_op(ctx, CMD_PUSH, CMD_QWORD, add_reg(ctx, embed_saved_regs[i]), NULL);
+
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_var(ctx, &(struct var) { .type = VAR_CONST_QWORD,
+			.value.value64 = ctx->tape_size }), add_reg(ctx, REG_RAX));
+	add_op(ctx, CMD_CMP, CMD_QWORD, add_reg(ctx, REG_RAX), add_reg(ctx, REG_RSI));
+	add_op(ctx, CMD_JB, CMD_QWORD, add_label_var(ctx, ".Lbf_tape_small"), NULL);
+
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_reg(ctx, REG_RDI), add_reg(ctx, REG_RBP));
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_reg(ctx, REG_RDX), add_reg(ctx, REG_R12));
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_reg(ctx, REG_RDX), add_reg(ctx, REG_R13));
+	add_op(ctx, CMD_ADD, CMD_QWORD, add_reg(ctx, REG_RCX), add_reg(ctx, REG_R13));
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_reg(ctx, REG_R8), add_reg(ctx, REG_RBX));
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_reg(ctx, REG_R8), add_reg(ctx, REG_R14));
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_reg(ctx, REG_R8), add_reg(ctx, REG_R15));
+	add_op(ctx, CMD_ADD, CMD_QWORD, add_reg(ctx, REG_R9), add_reg(ctx, REG_R15));
+}
 
-	struct var* rbp = add_var(&(struct var) { .type = VAR_REGISTER, .value.reg = REG_RBP });
-	struct var* rsp = add_var(&(struct var) { .type = VAR_REGISTER, .value.reg = REG_RSP }); 
-	add_cmd(&(struct cmd) { .type = CMD_MOV, .size = CMD_QWORD, .arg0 = rsp, .arg1 = rbp } );
+static void generate_embed_print(struct bfc_ctx* ctx)
+{
+	struct var* mem = add_var(ctx, &(struct var) { .type = VAR_MEM, .value.reg = REG_R14 });
 
-	var_stdin  = add_var(&(struct var) { .type = VAR_CONST, .value.value = 0 });
-	var_stdout = add_var(&(struct var) { .type = VAR_CONST, .value.value = 1 });
+	add_op(ctx, CMD_CMP, CMD_QWORD, add_reg(ctx, REG_R15), add_reg(ctx, REG_R14));
+	add_op(ctx, CMD_JE, CMD_QWORD, add_label_var(ctx, ".Lbf_out_full"), NULL);
+	add_op(ctx, CMD_MOV, CMD_BYTE, &ctx->bf_vars[ctx->crnt_var], add_reg(ctx, REG_AL));
+	add_op(ctx, CMD_MOV, CMD_BYTE, add_reg(ctx, REG_AL), mem);
+	add_op(ctx, CMD_ADD, CMD_QWORD, add_const(ctx, 1), add_reg(ctx, REG_R14));
 }
 
+static void generate_embed_get(struct bfc_ctx* ctx)
+{
+	struct var* mem = add_var(ctx, &(struct var) { .type = VAR_MEM, .value.reg = REG_R12 });
+	char name[MAX_LABEL_NAME];
+
+	sprintf(name, ".LI%zu%s", ctx->embed_input_count++, ctx->label_suffix);
+
+	if (ctx->cell_size != CMD_BYTE)
+		clear_var(ctx, &ctx->bf_vars[ctx->crnt_var]);
 
-static size_t level                          = 0;
-static size_t level_reparts[MAX_LEVEL_COUNT] = {0};
-static size_t crnt_var                       = 0;
-static struct var* zero_var;
+	add_op(ctx, CMD_CMP, CMD_QWORD, add_reg(ctx, REG_R13), add_reg(ctx, REG_R12));
+	add_op(ctx, CMD_JE, CMD_QWORD, add_label_var(ctx, name), NULL);
+	add_op(ctx, CMD_MOV, CMD_BYTE, mem, add_reg(ctx, REG_AL));
+	add_op(ctx, CMD_MOV, CMD_BYTE, add_reg(ctx, REG_AL), &ctx->bf_vars[ctx->crnt_var]);
+	add_op(ctx, CMD_ADD, CMD_QWORD, add_const(ctx, 1), add_reg(ctx, REG_R12));
+	add_label_cmd(ctx, LABEL, name);
+}
 
-static void generate_loop_start(void)
+static void generate_embed_epiloge(struct bfc_ctx* ctx)
 {
-	struct label* label = add_label(&(struct label) { .type = LABEL, .name = {0} });
-	sprintf(label->name, "B%zu_%zu", level_reparts[level], level);
-	add_cmd(&(struct cmd) { .type = CMD_LABEL, .arg0 = 0, .arg1 = 0, .label = label });
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_reg(ctx, REG_R14), add_reg(ctx, REG_RAX));
+	add_op(ctx, CMD_SUB, CMD_QWORD, add_reg(ctx, REG_RBX), add_reg(ctx, REG_RAX));
+
+	add_label_cmd(ctx, LABEL, ".Lbf_return");
+
+	for (size_t i = array_lenght(embed_saved_regs); i > 0; i--)
+		add_op(ctx, CMD_POP, CMD_QWORD, add_reg(ctx, embed_saved_regs[i - 1]), NULL);
+
+	add_op(ctx, CMD_RET, CMD_QWORD, NULL, NULL);
 
-	struct var* ah = add_var(&(struct var) { .type = VAR_REGISTER, .value.reg = REG_AH });
-	add_cmd(&(struct cmd) { .type = CMD_MOV, .size = CMD_BYTE, .arg0 = &bf_vars[crnt_var], .arg1 = ah });
-	add_cmd(&(struct cmd) { .type = CMD_CMP, .size = CMD_BYTE, .arg0 = zero_var, .arg1 = ah });
+	add_label_cmd(ctx, LABEL, ".Lbf_out_full");
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_const(ctx, -1), add_reg(ctx, REG_RAX));
+	add_op(ctx, CMD_JMP, CMD_QWORD, add_label_var(ctx, ".Lbf_return"), NULL);
 
-	struct var* end_label = add_var(&(struct var) { .type = VAR_LABEL });
-	sprintf(end_label->value.str, "E%zu_%zu", level_reparts[level], level);
-	add_cmd(&(struct cmd) { .type = CMD_JE, .arg0 = end_label });
+	add_label_cmd(ctx, LABEL, ".Lbf_tape_small");
+	add_op(ctx, CMD_MOV, CMD_QWORD, add_const(ctx, -2), add_reg(ctx, REG_RAX));
+	add_op(ctx, CMD_JMP, CMD_QWORD, add_label_var(ctx, ".Lbf_return"), NULL);
+}
+
+static void generate_prolouge(struct bfc_ctx* ctx)
+{
+	if (ctx->embed) {
+		generate_embed_prolouge(ctx);
+		return;
+	}
 
-	level++;
+	add_cmd(ctx, &(struct cmd) { .type = CMD_LABEL, .arg0 = NULL, .arg1 = NULL,
+			.label = add_label(ctx, &(struct label) { .type = LABEL_GLOBL, .name = "_start" })});
 }
 
-static void generate_loop_end(void)
+static void generate_loop_start(struct bfc_ctx* ctx)
 {
-	level--;
+	if (ctx->level >= MAX_LEVEL_COUNT)
+		compile_error(ctx, "loops are nested too deep");
+
+	ctx->level_cells[ctx->level] = &ctx->bf_vars[ctx->crnt_var];
 
-	struct var* start_label = add_var(&(struct var) { .type = VAR_LABEL });
-	sprintf(start_label->value.str, "B%zu_%zu", level_reparts[level], level);
-	add_cmd(&(struct cmd) { .type = CMD_JMP, .arg0 = start_label });
+	struct label* label = add_label(ctx, &(struct label) { .type = LABEL, .name = {0},
+			.cell = ctx->level_cells[ctx->level] });
+	sprintf(label->name, "B%zu_%zu%s", ctx->level_reparts[ctx->level], ctx->level, ctx->label_suffix);
+	add_cmd(ctx, &(struct cmd) { .type = CMD_LABEL, .arg0 = 0, .arg1 = 0, .label = label });
 
-	struct label* label = add_label(&(struct label) { .type = LABEL, .name = {0} });
-	sprintf(label->name, "E%zu_%zu", level_reparts[level], level);
-	add_cmd(&(struct cmd) { .type = CMD_LABEL, .arg0 = 0, .arg1 = 0, .label = label });
+	struct var* reg = add_var(ctx, &(struct var) { .type = VAR_REGISTER, .value.reg = cell_reg(ctx) });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_MOV, .size = ctx->cell_size,
+			.arg0 = &ctx->bf_vars[ctx->crnt_var], .arg1 = reg });
+	add_cmd(ctx, &(struct cmd) { .type = CMD_CMP, .size = ctx->cell_size, .arg0 = ctx->zero_var,
+			.arg1 = reg });
 
-	level_reparts[level]++;
+	struct var* end_label = add_var(ctx, &(struct var) { .type = VAR_LABEL });
+	sprintf(end_label->value.str, "E%zu_%zu%s", ctx->level_reparts[ctx->level], ctx->level,
+			ctx->label_suffix);
+	add_cmd(ctx, &(struct cmd) { .type = CMD_JE, .arg0 = end_label });
+
+	ctx->level++;
 }
 
-static void generate_print(void)
+static void generate_loop_end(struct bfc_ctx* ctx)
 {
-	struct var* rsi = add_var(&(struct var) { .type = VAR_REGISTER, .value.reg = REG_RSI });
+	if (ctx->level == 0)
+		compile_error(ctx, "unmatched ]");
 
-	add_cmd(&(struct cmd) { .type = CMD_LEA, .size = CMD_QWORD, .arg0 = &bf_vars[crnt_var],
-			.arg1 = rsi });
+	ctx->level--;
 
-	compile_syscall(add_var(&(struct var) { .type = VAR_CONST, .value.value = 1 }), var_stdout,
-			rsi, add_var(&(struct var) { .type = VAR_CONST, .value.value = 1 }));
+	struct var* start_label = add_var(ctx, &(struct var) { .type = VAR_LABEL });
+	sprintf(start_label->value.str, "B%zu_%zu%s", ctx->level_reparts[ctx->level], ctx->level,
+			ctx->label_suffix);
+	add_cmd(ctx, &(struct cmd) { .type = CMD_JMP, .arg0 = start_label });
+
+	struct label* label = add_label(ctx, &(struct label) { .type = LABEL, .name = {0},
+			.cell = ctx->level_cells[ctx->level] });
+	sprintf(label->name, "E%zu_%zu%s", ctx->level_reparts[ctx->level], ctx->level, ctx->label_suffix);
+	add_cmd(ctx, &(struct cmd) { .type = CMD_LABEL, .arg0 = 0, .arg1 = 0, .label = label });
+
+	ctx->level_reparts[ctx->level]++;
 }
 
-static void generate_get(void)
+static void generate_print(struct bfc_ctx* ctx)
 {
-	struct var* rsi = add_var(&(struct var) { .type = VAR_REGISTER, .value.reg = REG_RSI });
+	struct var* rsi = add_var(ctx, &(struct var) { .type = VAR_REGISTER, .value.reg = REG_RSI });
+
+	if (ctx->embed) {
+		generate_embed_print(ctx);
+		return;
+	}
 
-	add_cmd(&(struct cmd) { .type = CMD_LEA, .size = CMD_QWORD, .arg0 = &bf_vars[crnt_var],
+	add_cmd(ctx, &(struct cmd) { .type = CMD_LEA, .size = CMD_QWORD, .arg0 = &ctx->bf_vars[ctx->crnt_var],
 			.arg1 = rsi });
 
-	compile_syscall(add_var(&(struct var) { .type = VAR_CONST, .value.value = 0 }), var_stdin,
-			rsi, add_var(&(struct var) { .type = VAR_CONST, .value.value = 1 }));
+	compile_syscall(ctx, add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 1 }),
+			ctx->var_stdout, rsi, add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 1 }));
 }
 
-static void generate_epiloge(void)
+static void generate_get(struct bfc_ctx* ctx)
 {
-	compile_syscall(add_var(&(struct var) { .type = VAR_CONST, .value.value = 60 }),
-			zero_var, NULL, NULL);
+	struct var* rsi = add_var(ctx, &(struct var) { .type = VAR_REGISTER, .value.reg = REG_RSI });
+
+	if (ctx->embed) {
+		generate_embed_get(ctx);
+		return;
+	}
+
+	if (ctx->cell_size != CMD_BYTE)
+		clear_var(ctx, &ctx->bf_vars[ctx->crnt_var]);
+
+	add_cmd(ctx, &(struct cmd) { .type = CMD_LEA, .size = CMD_QWORD, .arg0 = &ctx->bf_vars[ctx->crnt_var],
+			.arg1 = rsi });
+
+	compile_syscall(ctx, add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 0 }),
+			ctx->var_stdin, rsi, add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 1 }));
 }
 
-static void compile(const char* str)
+static void generate_epiloge(struct bfc_ctx* ctx)
 {
-	generate_prolouge();
+	if (ctx->embed) {
+		generate_embed_epiloge(ctx);
+		return;
+	}
 
-	zero_var = add_var(&(struct var) { .type = VAR_CONST, .value.value = 0 });
+	compile_syscall(ctx, add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 60 }),
+			ctx->zero_var, NULL, NULL);
+}
 
-	clear_var(&bf_vars[0]);
+static void alloc_cells(struct bfc_ctx* ctx, size_t count)
+{
+	ctx->bf_vars     = calloc(count, sizeof(struct var));
+	ctx->cell_states = calloc(count, sizeof(struct cell_state));
+	ctx->is_read     = malloc(count * sizeof(bool));
+	ctx->cell_count  = count;
 
-	size_t unique_var_counter = 0;
+	if (count != 0 && (ctx->bf_vars == NULL || ctx->cell_states == NULL || ctx->is_read == NULL))
+		compile_error(ctx, "out of memory");
+}
 
-	for (const char* c = str; *c != '\0'; c++) switch (*c) {
-	case '>':
-		crnt_var++;
-		if (crnt_var > unique_var_counter) {
-			unique_var_counter++;
-			clear_var(&bf_vars[crnt_var]);
-		}
+static size_t count_cells(struct bfc_ctx* ctx, const char* str, size_t len)
+{
+	size_t max_cells = ctx->tape_size / cell_bytes(ctx);
+	size_t pos       = ctx->crnt_var;
+	size_t max       = pos;
+
+	for (size_t i = 0; i < len && max < max_cells; i++) {
+		if (str[i] == '>' && ++pos > max)
+			max = pos;
+		else if (str[i] == '<' && pos > 0)
+			pos--;
+	}
 
-		break;
+	return max < max_cells ? max + 1 : max_cells;
+}
 
-	case '<':
-		crnt_var--;
-		break;
+static void compile_update(struct bfc_ctx* ctx, enum cmd_type type, size_t count)
+{
+	while (count > 0) {
+		size_t part = count > INT32_MAX ? INT32_MAX : count;
+
+		add_cmd(ctx, &(struct cmd) {
+				.type = type,
+				.size = ctx->cell_size,
+				.arg0 = add_var(ctx, &(struct var) {
+						.type = VAR_CONST, .value.value = wrap_value(part, ctx->cell_size)}),
+				.arg1 = &ctx->bf_vars[ctx->crnt_var],
+		});
 
-	default:
-		break;
+		count -= part;
 	}
+}
+
+static void compile(struct bfc_ctx* ctx, const char* str, size_t len)
+{
+	const char* str_end = str + len;
 
-	crnt_var           = 0;
-	unique_var_counter = 0;
+	alloc_cells(ctx, count_cells(ctx, str, len));
 
-	for (const char* c = str; *c != '\0'; c++) switch (*c) {
+	if (ctx->has_prolouge)
+		generate_prolouge(ctx);
+
+	ctx->zero_var   = add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 0 });
+	ctx->var_stdin  = add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 0 });
+	ctx->var_stdout = add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = 1 });
+
+	for (const char* c = str; c < str_end; c++) switch (*c) {
 	case '>':
-		crnt_var++;
+		if (++ctx->crnt_var >= ctx->cell_count)
+			compile_error(ctx, "tape pointer moves past the end of tape");
+
 		break;
 	
 	case '<':
-		crnt_var--;
+		if (ctx->crnt_var-- == 0)
+			compile_error(ctx, "tape pointer moves before the start of tape");
+
 		break;
 
 	case '+': {
 		size_t add_count = 0;
-		for (; *c == '+'; c++, add_count++);
+		for (; c < str_end && *c == '+'; c++, add_count++);
 		c--;
 
-		add_cmd(&(struct cmd) {
-				.type = CMD_ADD,
-				.size = CMD_BYTE,
-				.arg0 = add_var(&(struct var) {
-						.type = VAR_CONST, .value.value = add_count}),
-				.arg1 = &bf_vars[crnt_var],
-		});
-
+		compile_update(ctx, CMD_ADD, add_count);
 		break;
 	}
 
 	case '-': {
 		size_t sub_count = 0;
-		for (; *c == '-'; c++, sub_count++);
+		for (; c < str_end && *c == '-'; c++, sub_count++);
 		c--;
 
-		add_cmd(&(struct cmd) {
-				.type = CMD_SUB,
-				.size = CMD_BYTE,
-				.arg0 = add_var(&(struct var) {
-						.type = VAR_CONST, .value.value = sub_count}),
-				.arg1 = &bf_vars[crnt_var],
-		});
-
+		compile_update(ctx, CMD_SUB, sub_count);
 		break;
 	}
 	
 	case '[':
-		generate_loop_start();
+		generate_loop_start(ctx);
 		break;
 	
 	case ']':
-		generate_loop_end();
+		generate_loop_end(ctx);
 		break;
 
 	case '.':
-		generate_print();
+		generate_print(ctx);
 		break;
 
 	case ',':
-		generate_get();
+		generate_get(ctx);
 		break;
 
 	default:
 		  break;
 	}
 
-	generate_epiloge();
+	if (ctx->level != 0)
+		compile_error(ctx, "unmatched [");
+
+	if (ctx->has_epiloge)
+		generate_epiloge(ctx);
 }
 
-static struct var_lifetime get_var_lifetime(struct var* var)
+static struct var_lifetime get_var_lifetime(struct bfc_ctx* ctx, struct var* var)
 {
 	struct var_lifetime lifetime;
 	uint32_t last_usage;
 	bool start_set = false;
 
-	for (int i = 0; i < cmd_count; i++) {
-		struct cmd* cmd = &cmds[i];
+	for (int i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
 		struct var* found;
 
 		if (cmd->arg0 != NULL) {
@@ -399,10 +1018,10 @@ done:
 	return lifetime;
 }
 
-static bool try_dispence_with_register(struct var* var, enum reg reg)
+static bool try_dispence_with_register(struct bfc_ctx* ctx, struct var* var, enum reg reg)
 {
-	for (int i = 0; i < cmd_count; i++) {
-		struct cmd* cmd = &cmds[i];
+	for (int i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
 		struct var* found;
 
 		if (cmd->arg0 != NULL) {
@@ -420,8 +1039,8 @@ process_founded:
 		if (var->type != VAR_REGISTER || var->value.reg != reg)
 			goto done;
 
-		struct var_lifetime found_lifetime = get_var_lifetime(found);
-		struct var_lifetime var_lifetime   = get_var_lifetime(var);
+		struct var_lifetime found_lifetime = get_var_lifetime(ctx, found);
+		struct var_lifetime var_lifetime   = get_var_lifetime(ctx, var);
 
 		if (var_lifetime.start_instr < found_lifetime.end_instr ||
 			var_lifetime.end_instr > found_lifetime.start_instr)
@@ -440,65 +1059,84 @@ done:
 	return true;
 }
 
-static bool try_dispence_with_registers_and_reg_array(struct var* var, enum reg* regs, size_t reg_count)
+static bool try_dispence_with_registers_and_reg_array(struct bfc_ctx* ctx, struct var* var, enum reg* regs,
+		size_t reg_count)
 {
 	for (int i = 0; i < reg_count; i++) {
 		enum reg reg = regs[i];
 
-		if (try_dispence_with_register(var, reg))
+		if (try_dispence_with_register(ctx, var, reg))
 			return true;
 	}
 
 	return false;
 }
 
-static bool try_dispence_with_registers(struct var* var, enum cmd_size size)
+static bool try_dispence_with_registers(struct bfc_ctx* ctx, struct var* var, enum cmd_size size)
 {
 	static enum reg byte_regs[] = { REG_AH, REG_AL, REG_BH, REG_BL, REG_CH, REG_CL, REG_DH, REG_DL };
 
 	switch (size) {
-	case CMD_BYTE: return try_dispence_with_registers_and_reg_array(var, byte_regs,
+	case CMD_BYTE: return try_dispence_with_registers_and_reg_array(ctx, var, byte_regs,
 				       array_lenght(byte_regs));
 
 	default: return false;
 	}
 }
 
-static size_t stack_offset = 0;
-
-static void dispence_with_stack(struct var* var)
+static void dispence_with_stack(struct bfc_ctx* ctx, struct var* var)
 {
 	var->type               = VAR_STACK;
-	var->value.stack_offset = stack_offset;
-	stack_offset += 8;
+	var->value.stack_offset = cell_index(ctx, var) * cell_bytes(ctx);
 }
 
-static void dispence_register(struct var* var, struct cmd* cmd)
+static void dispence_register(struct bfc_ctx* ctx, struct var* var, struct cmd* cmd)
 {
 	if (var->type != VAR_PROG)
 		return;
 
-	dispence_with_stack(var);
+	dispence_with_stack(ctx, var);
 }
 
-static void dispence_registers(void)
+static void dispence_registers(struct bfc_ctx* ctx)
 {
-	for (int i = 0; i < cmd_count; i++) {
-		struct cmd* cmd = &cmds[i];
+	for (int i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
 
-		if (cmd->arg0 != NULL) dispence_register(cmd->arg0, cmd);
-		if (cmd->arg1 != NULL) dispence_register(cmd->arg1, cmd);
+		if (cmd->arg0 != NULL) dispence_register(ctx, cmd->arg0, cmd);
+		if (cmd->arg1 != NULL) dispence_register(ctx, cmd->arg1, cmd);
 	}
 }
 
-static size_t const_str_num = 0;
+static bool is_data_var(struct var* var)
+{
+	return var->type == VAR_CONST_STR || var->type == VAR_CONST_VEC;
+}
 
-static void add_data_variable(struct var* var, FILE* file)
+static void add_data_variable(struct bfc_ctx* ctx, struct var* var, FILE* file)
 {
-	if (var->type != VAR_CONST_STR)
-		return;
+	if (is_data_var(var) && ctx->data_nums[var->id] == 0)
+		ctx->data_nums[var->id] = ctx->const_str_num + 1;
+
+	switch (var->type) {
+	case VAR_CONST_STR:
+		fprintf(file, "\tS%zu%s%s: .ascii \"%s\"\n", ctx->const_str_num++, ctx->label_suffix,
+				ctx->variant_suffix, var->value.str);
+		break;
+
+	case VAR_CONST_VEC:
+		fprintf(file, "\t.balign %zu\n\tS%zu%s%s: .byte ", vec_bytes(ctx), ctx->const_str_num++,
+				ctx->label_suffix, ctx->variant_suffix);
+
+		for (size_t i = 0; i < vec_bytes(ctx); i++)
+			fprintf(file, i == 0 ? "%u" : ", %u", (uint8_t) var->value.str[i]);
+
+		fputc('\n', file);
+		break;
 
-	fprintf(file, "\tS%zu: .ascii \"%s\"\n", const_str_num++, var->value.str);
+	default:
+		break;
+	}
 }
 
 static void print_reg(enum reg reg, FILE* file)
@@ -512,6 +1150,22 @@ static void print_reg(enum reg reg, FILE* file)
 		fprintf(file, "al");
 		break;
 
+	case REG_AX:
+		fprintf(file, "ax");
+		break;
+
+	case REG_EAX:
+		fprintf(file, "eax");
+		break;
+
+	case REG_DX:
+		fprintf(file, "dx");
+		break;
+
+	case REG_EDX:
+		fprintf(file, "edx");
+		break;
+
 	case REG_BH:
 		fprintf(file, "bh");
 		break;
@@ -560,39 +1214,77 @@ static void print_reg(enum reg reg, FILE* file)
 		fprintf(file, "rsp");
 		break;
 
-	default:
+	case REG_R8:
+		fprintf(file, "r8");
 		break;
-	}
-}
 
-static void print_const_str(struct var* var, FILE* file)
-{
-	size_t const_str = 0;
+	case REG_R9:
+		fprintf(file, "r9");
+		break;
 
-	for (int i = 0; i < cmd_count; i++) {
-		struct cmd* cmd = &cmds[i];
+	case REG_R10:
+		fprintf(file, "r10");
+		break;
 
-		if (cmd->arg0 != NULL && cmd->arg0->type == VAR_CONST_STR) const_str++;
-		if (cmd->arg0 == var)
-			break;
+	case REG_R12:
+		fprintf(file, "r12");
+		break;
 
-		if (cmd->arg1 != NULL && cmd->arg1->type == VAR_CONST_STR) const_str++;
-		if (cmd->arg1 == var)
-			break;
+	case REG_R13:
+		fprintf(file, "r13");
+		break;
+
+	case REG_R14:
+		fprintf(file, "r14");
+		break;
+
+	case REG_R15:
+		fprintf(file, "r15");
+		break;
+
+	case REG_RBX:
+		fprintf(file, "rbx");
+		break;
+
+	case REG_RCX:
+		fprintf(file, "rcx");
+		break;
+
+	case REG_XMM0:
+		fprintf(file, "xmm0");
+		break;
+
+	case REG_YMM0:
+		fprintf(file, "ymm0");
+		break;
+
+	case REG_ZMM0:
+		fprintf(file, "zmm0");
+		break;
+
+	default:
+		break;
 	}
+}
 
-	fprintf(file, "S%zu", const_str - 1);
+static void print_const_str(struct bfc_ctx* ctx, struct var* var, FILE* file)
+{
+	fprintf(file, "S%zu%s%s", ctx->data_nums[var->id] - 1, ctx->label_suffix, ctx->variant_suffix);
 }
 
-static void print_var(struct var* var, FILE* file)
+static void print_var(struct bfc_ctx* ctx, struct var* var, FILE* file)
 {
 	switch (var->type) {
 	case VAR_CONST:
-		fprintf(file, "$%i", var->value.value);
+		fprintf(file, "$%" PRIi64, const_value(var));
 		break;
 	
+	case VAR_CONST_QWORD:
+		fprintf(file, "$%" PRIu64, var->value.value64);
+		break;
+
 	case VAR_STACK:
-		fprintf(file, "-%zu(%%rbp)", var->value.stack_offset + 1);
+		fprintf(file, "%zu(%%rbp)", var->value.stack_offset);
 		break;
 
 	case VAR_REGISTER:
@@ -601,16 +1293,26 @@ static void print_var(struct var* var, FILE* file)
 		break;
 
 	case VAR_CONST_STR:
-		print_const_str(var, file);
+		print_const_str(ctx, var, file);
+		break;
+
+	case VAR_CONST_VEC:
+		print_const_str(ctx, var, file);
+		fprintf(file, "(%%rip)");
 		break;
 
 	case VAR_LABEL:
-		fprintf(file, "%s", var->value.str);
+		fprintf(file, "%s%s", var->value.str, ctx->variant_suffix);
+		break;
+
+	case VAR_MEM:
+		fprintf(file, "(%%");
+		print_reg(var->value.reg, file);
+		fputc(')', file);
 		break;
 
 	case VAR_PROG:
-		fprintf(stderr, "bfc1: invalid internal state\n");
-		exit(1);
+		compile_error(ctx, "invalid internal state");
 	}
 }
 
@@ -639,30 +1341,59 @@ static void print_prefix(FILE* file, enum cmd_size* size)
 	}
 }
 
-static void create_asm(FILE* file)
+static const char* vec_movs[] = { "movdqu", "vmovdqu", "vmovdqu64" };
+static const char* vec_ands[] = { "pand", "vpand", "vpandq" };
+
+static size_t vec_level(struct cmd* cmd)
 {
-	fprintf(file, ".data\n");
+	struct var* reg = cmd->arg1->type == VAR_REGISTER ? cmd->arg1 : cmd->arg0;
 
-	for (int i = 0; i < cmd_count; i++) {
-		struct cmd* cmd = &cmds[i];
+	return reg->value.reg - REG_XMM0;
+}
 
-		if (cmd->arg0 != NULL) add_data_variable(cmd->arg0, file);
-		if (cmd->arg1 != NULL) add_data_variable(cmd->arg1, file);
-	}
+static void print_vec_args(struct bfc_ctx* ctx, struct cmd* cmd, FILE* file)
+{
+	print_var(ctx, cmd->arg0, file);
+	fprintf(file, ", ");
+
+	if (vec_level(cmd) != 0) {
+		print_var(ctx, cmd->arg1, file);
+		fprintf(file, ", ");
+	}
+
+	print_var(ctx, cmd->arg1, file);
+	fprintf(file, "\n");
+}
+
+static void create_asm(struct bfc_ctx* ctx, FILE* file)
+{
+	free(ctx->data_nums);
+	ctx->data_nums = calloc(ctx->var_count + 1, sizeof(size_t));
+	if (ctx->data_nums == NULL)
+		compile_error(ctx, "out of memory");
+
+	fprintf(file, ".data\n");
+
+	for (int i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		if (cmd->arg0 != NULL) add_data_variable(ctx, cmd->arg0, file);
+		if (cmd->arg1 != NULL) add_data_variable(ctx, cmd->arg1, file);
+	}
 
 	fprintf(file, ".text\n");
 	
-	for (int i = 0; i < cmd_count; i++) {
-		struct cmd* cmd = &cmds[i];
+	for (int i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
 
 		switch (cmd->type) {
 		case CMD_ADD:	
 			fprintf(file, "\tadd");
 			print_prefix(file, &cmd->size);
 			fputc(' ', file);
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, ", ");
-			print_var(cmd->arg1, file);
+			print_var(ctx, cmd->arg1, file);
 			fprintf(file, "\n");
 
 			break;
@@ -671,9 +1402,9 @@ static void create_asm(FILE* file)
 			fprintf(file, "\tmov");
 			print_prefix(file, &cmd->size);
 			fputc(' ', file);
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, ", ");
-			print_var(cmd->arg1, file);
+			print_var(ctx, cmd->arg1, file);
 			fprintf(file, "\n");
 
 			break;
@@ -682,9 +1413,9 @@ static void create_asm(FILE* file)
 			fprintf(file, "\tsub");
 			print_prefix(file, &cmd->size);
 			fputc(' ', file);
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, ", ");
-			print_var(cmd->arg1, file);
+			print_var(ctx, cmd->arg1, file);
 			fprintf(file, "\n");
 
 			break;
@@ -693,9 +1424,20 @@ static void create_asm(FILE* file)
 			fprintf(file, "\txor");
 			print_prefix(file, &cmd->size);
 			fputc(' ', file);
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
+			fprintf(file, ", ");
+			print_var(ctx, cmd->arg1, file);
+			fprintf(file, "\n");
+
+			break;
+
+		case CMD_IMUL:
+			fprintf(file, "\timul");
+			print_prefix(file, &cmd->size);
+			fputc(' ', file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, ", ");
-			print_var(cmd->arg1, file);
+			print_var(ctx, cmd->arg1, file);
 			fprintf(file, "\n");
 
 			break;
@@ -705,51 +1447,74 @@ static void create_asm(FILE* file)
 			break;
 
 		case CMD_LABEL:
-			if (cmd->label->type == LABEL_GLOBL)
+			if (cmd->label->type == LABEL_GLOBL && ctx->variant_suffix[0] == '\0')
 				fprintf(file, ".globl %s\n", cmd->label->name);
 
-			fprintf(file, "%s:\n", cmd->label->name);
+			if (cmd->label->type == LABEL_GLOBL && ctx->embed && ctx->variant_suffix[0] == '\0')
+				fprintf(file, ".type %s, @function\n", cmd->label->name);
+
+			fprintf(file, "%s%s:\n", cmd->label->name, ctx->variant_suffix);
 
 			break;
 
 		case CMD_JE:
 			fprintf(file, "\tje ");
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, "\n");
 
 			break;
 
 		case CMD_JNE:
 			fprintf(file, "\tjne ");
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, "\n");
 
 			break;
 
 		case CMD_JMP:
 			fprintf(file, "\tjmp ");
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
+			fprintf(file, "\n");
+
+			break;
+
+		case CMD_JA:
+			fprintf(file, "\tja ");
+			print_var(ctx, cmd->arg0, file);
+			fprintf(file, "\n");
+
+			break;
+
+		case CMD_JB:
+			fprintf(file, "\tjb ");
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, "\n");
 
 			break;
 
+		case CMD_RET:
+			if (ctx->use_vec && vec_bytes(ctx) > 16)
+				fprintf(file, "\tvzeroupper\n");
+
+			fprintf(file, "\tret\n");
+			break;
+
 		case CMD_CMP:
 			fprintf(file, "\tcmp");
 			print_prefix(file, &cmd->size);
 			fputc(' ', file);
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, ", ");
-			print_var(cmd->arg1, file);
+			print_var(ctx, cmd->arg1, file);
 			fprintf(file, "\n");
 
 			break;
 
-
 		case CMD_PUSH:
 			fprintf(file, "\tpush");
 			print_prefix(file, &cmd->size);
 			fputc(' ', file);
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, "\n");
 
 			break;
@@ -758,7 +1523,7 @@ static void create_asm(FILE* file)
 			fprintf(file, "\tpop");
 			print_prefix(file, &cmd->size);
 			fputc(' ', file);
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, "\n");
 
 			break;
@@ -767,39 +1532,553 @@ static void create_asm(FILE* file)
 			fprintf(file, "\tlea");
 			print_prefix(file, &cmd->size);
 			fputc(' ', file);
-			print_var(cmd->arg0, file);
+			print_var(ctx, cmd->arg0, file);
+			fprintf(file, ", ");
+			print_var(ctx, cmd->arg1, file);
+			fprintf(file, "\n");
+
+			break;
+
+		case CMD_MOVDQU:
+			fprintf(file, "\t%s ", vec_movs[vec_level(cmd)]);
+			print_var(ctx, cmd->arg0, file);
 			fprintf(file, ", ");
-			print_var(cmd->arg1, file);
+			print_var(ctx, cmd->arg1, file);
 			fprintf(file, "\n");
 
 			break;
 
+		case CMD_PAND:
+			fprintf(file, "\t%s ", vec_ands[vec_level(cmd)]);
+			print_vec_args(ctx, cmd, file);
+
+			break;
+
+		case CMD_PADD:
+			fprintf(file, "\t%spadd%c ", vec_level(cmd) == 0 ? "" : "v", "bwdq"[cmd->size]);
+			print_vec_args(ctx, cmd, file);
+
+			break;
+
+		default:
+			break;
+		}
+	}
+
+	if (ctx->embed && ctx->has_epiloge)
+		fprintf(file, ".section .note.GNU-stack,\"\",@progbits\n");
+}
+
+struct reg_part {
+	const char* base;
+	enum cmd_size size;
+	bool is_high;
+};
+
+static const struct reg_part reg_parts[] = {
+	[REG_AH]  = { "rax", CMD_BYTE, true },
+	[REG_AL]  = { "rax", CMD_BYTE },
+	[REG_AX]  = { "rax", CMD_WORD },
+	[REG_EAX] = { "rax", CMD_DWORD },
+	[REG_DX]  = { "rdx", CMD_WORD },
+	[REG_EDX] = { "rdx", CMD_DWORD },
+	[REG_CH]  = { "rcx", CMD_BYTE, true },
+	[REG_CL]  = { "rcx", CMD_BYTE },
+	[REG_DH]  = { "rdx", CMD_BYTE, true },
+	[REG_DL]  = { "rdx", CMD_BYTE },
+	[REG_BH]  = { "rbx", CMD_BYTE, true },
+	[REG_BL]  = { "rbx", CMD_BYTE },
+	[REG_RAX] = { "rax", CMD_QWORD },
+	[REG_RDI] = { "rdi", CMD_QWORD },
+	[REG_RSI] = { "rsi", CMD_QWORD },
+	[REG_RDX] = { "rdx", CMD_QWORD },
+	[REG_RBP] = { "rbp", CMD_QWORD },
+	[REG_RSP] = { "rsp", CMD_QWORD },
+	[REG_R8]  = { "r8",  CMD_QWORD },
+	[REG_R9]  = { "r9",  CMD_QWORD },
+	[REG_R10] = { "r10", CMD_QWORD },
+	[REG_R12] = { "r12", CMD_QWORD },
+	[REG_R13] = { "r13", CMD_QWORD },
+	[REG_R14] = { "r14", CMD_QWORD },
+	[REG_R15] = { "r15", CMD_QWORD },
+	[REG_RBX] = { "rbx", CMD_QWORD },
+	[REG_RCX] = { "rcx", CMD_QWORD },
+};
+
+static const char* c_types[] = { "uint8_t", "uint16_t", "uint32_t", "uint64_t" };
+static const char* llvm_types[] = { "i8", "i16", "i32", "i64" };
+
+static void unsupported_cmd(struct bfc_ctx* ctx, const char* name)
+{
+	compile_error(ctx, "%s backend can't lower this command", name);
+}
+
+static const struct reg_part* get_reg_part(struct bfc_ctx* ctx, struct var* var, const char* name)
+{
+	if (var->value.reg >= array_lenght(reg_parts) || reg_parts[var->value.reg].base == NULL)
+		unsupported_cmd(ctx, name);
+
+	return &reg_parts[var->value.reg];
+}
+
+static void print_c_read(struct bfc_ctx* ctx, struct var* var, enum cmd_size size, FILE* file)
+{
+	const struct reg_part* part;
+
+	switch (var->type) {
+	case VAR_CONST:
+		if (const_value(var) == (int32_t) const_value(var))
+			fprintf(file, "(%s) (int32_t) %i", c_types[size], (int32_t) const_value(var));
+		else
+			fprintf(file, "(%s) UINT64_C(%" PRIu64 ")", c_types[size], var->value.value);
+		break;
+
+	case VAR_STACK:
+		fprintf(file, "tape[%zu]", cell_index(ctx, var));
+		break;
+
+	case VAR_REGISTER:
+		part = get_reg_part(ctx, var, "c");
+		fprintf(file, part->is_high ? "(%s) (%s >> 8)" : "(%s) %s", c_types[size], part->base);
+		break;
+
+	default:
+		unsupported_cmd(ctx, "c");
+	}
+}
+
+static void print_c_write(struct bfc_ctx* ctx, struct var* var, FILE* file)
+{
+	const struct reg_part* part;
+
+	switch (var->type) {
+	case VAR_STACK:
+		fprintf(file, "\ttape[%zu] = ", cell_index(ctx, var));
+		break;
+
+	case VAR_REGISTER:
+		part = get_reg_part(ctx, var, "c");
+
+		if (part->is_high)
+			fprintf(file, "\tSET_HIGH(%s, ", part->base);
+		else
+			fprintf(file, "\tSET_%s(%s, ", c_types[part->size], part->base);
+
+		break;
+
+	default:
+		unsupported_cmd(ctx, "c");
+	}
+}
+
+static void print_c_write_end(struct var* var, FILE* file)
+{
+	fprintf(file, var->type == VAR_REGISTER ? ");\n" : ";\n");
+}
+
+static void print_c_binary(struct bfc_ctx* ctx, struct cmd* cmd, const char* op, FILE* file)
+{
+	print_c_write(ctx, cmd->arg1, file);
+	fprintf(file, "(%s) (", c_types[cmd->size]);
+	print_c_read(ctx, cmd->arg1, cmd->size, file);
+	fprintf(file, " %s ", op);
+	print_c_read(ctx, cmd->arg0, cmd->size, file);
+	fputc(')', file);
+	print_c_write_end(cmd->arg1, file);
+}
+
+static void create_c(struct bfc_ctx* ctx, FILE* file)
+{
+	fprintf(file,
+		"#include <stdbool.h>\n"
+		"#include <stdint.h>\n"
+		"#include <stdio.h>\n"
+		"#include <stdlib.h>\n"
+		"\n"
+		"#define SET_HIGH(r, v) r = (r & ~(uint64_t) 0xff00) | (uint64_t) (uint8_t) (v) << 8\n"
+		"#define SET_uint8_t(r, v) r = (r & ~(uint64_t) 0xff) | (uint8_t) (v)\n"
+		"#define SET_uint16_t(r, v) r = (r & ~(uint64_t) 0xffff) | (uint16_t) (v)\n"
+		"#define SET_uint32_t(r, v) r = (uint32_t) (v)\n"
+		"#define SET_uint64_t(r, v) r = (uint64_t) (v)\n"
+		"\n"
+		"static %s tape[%zu];\n"
+		"\n"
+		"static inline void bf_syscall(uint64_t num, uint64_t arg0, uint64_t arg1)\n"
+		"{\n"
+		"\tint c;\n"
+		"\n"
+		"\tswitch (num) {\n"
+		"\tcase 0:\n"
+		"\t\tif ((c = getchar_unlocked()) != EOF)\n"
+		"\t\t\t*(uint8_t*) (uintptr_t) arg1 = c;\n"
+		"\t\tbreak;\n"
+		"\n"
+		"\tcase 1:\n"
+		"\t\tputchar_unlocked(*(uint8_t*) (uintptr_t) arg1);\n"
+		"\t\tbreak;\n"
+		"\n"
+		"\tcase 60:\n"
+		"\t\texit(arg0);\n"
+		"\t}\n"
+		"}\n"
+		"\n"
+		"int main(void)\n"
+		"{\n"
+		"\tuint64_t rax = 0, rbx = 0, rcx = 0, rdx = 0, rdi = 0, rsi = 0, rbp = 0, rsp = 0;\n"
+		"\tuint64_t r8 = 0, r9 = 0, r10 = 0;\n"
+		"\tbool zf = false, af = false;\n"
+		"\n",
+		c_types[ctx->cell_size], ctx->tape_size / cell_bytes(ctx));
+
+	for (int i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		switch (cmd->type) {
+		case CMD_ADD:
+			print_c_binary(ctx, cmd, "+", file);
+			break;
+
+		case CMD_SUB:
+			print_c_binary(ctx, cmd, "-", file);
+			break;
+
+		case CMD_XOR:
+			print_c_binary(ctx, cmd, "^", file);
+			break;
+
+		case CMD_IMUL:
+			print_c_binary(ctx, cmd, "*", file);
+			break;
+
+		case CMD_MOV:
+			print_c_write(ctx, cmd->arg1, file);
+			print_c_read(ctx, cmd->arg0, cmd->size, file);
+			print_c_write_end(cmd->arg1, file);
+			break;
+
+		case CMD_LEA:
+			print_c_write(ctx, cmd->arg1, file);
+			fprintf(file, "(uintptr_t) &tape[%zu]", cell_index(ctx, cmd->arg0));
+			print_c_write_end(cmd->arg1, file);
+			break;
+
+		case CMD_CMP:
+			fprintf(file, "\tzf = ");
+			print_c_read(ctx, cmd->arg1, cmd->size, file);
+			fprintf(file, " == ");
+			print_c_read(ctx, cmd->arg0, cmd->size, file);
+			fprintf(file, ";\n\taf = ");
+			print_c_read(ctx, cmd->arg1, cmd->size, file);
+			fprintf(file, " > ");
+			print_c_read(ctx, cmd->arg0, cmd->size, file);
+			fprintf(file, ";\n");
+			break;
+
+		case CMD_JE:
+			fprintf(file, "\tif (zf) goto %s;\n", cmd->arg0->value.str);
+			break;
+
+		case CMD_JNE:
+			fprintf(file, "\tif (!zf) goto %s;\n", cmd->arg0->value.str);
+			break;
+
+		case CMD_JA:
+			fprintf(file, "\tif (af) goto %s;\n", cmd->arg0->value.str);
+			break;
+
+		case CMD_JMP:
+			fprintf(file, "\tgoto %s;\n", cmd->arg0->value.str);
+			break;
+
+		case CMD_LABEL:
+			if (cmd->label->type != LABEL_GLOBL)
+				fprintf(file, "%s:;\n", cmd->label->name);
+			break;
+
+		case CMD_SYSCALL:
+			fprintf(file, "\tbf_syscall(rax, rdi, rsi);\n");
+			break;
+
+		case CMD_EMPTY:
+			break;
+
 		default:
+			unsupported_cmd(ctx, "c");
+		}
+	}
+
+	fprintf(file,
+		"\n"
+		"\t(void) rax; (void) rbx; (void) rcx; (void) rdx; (void) rdi; (void) rsi;\n"
+		"\t(void) rbp; (void) rsp; (void) r8; (void) r9; (void) r10; (void) zf; (void) af;\n"
+		"\n"
+		"\treturn 0;\n"
+		"}\n");
+}
+
+static void llvm_read(struct bfc_ctx* ctx, struct var* var, enum cmd_size size, char* value, FILE* file)
+{
+	const struct reg_part* part;
+	size_t base;
+
+	switch (var->type) {
+	case VAR_CONST:
+		sprintf(value, "%" PRIi64, const_value(var));
+		return;
+
+	case VAR_STACK:
+		fprintf(file, "\t%%t%zu = getelementptr inbounds %s, ptr @tape, i64 %zu\n",
+				ctx->llvm_tmp, llvm_types[ctx->cell_size], cell_index(ctx, var));
+		fprintf(file, "\t%%t%zu = load %s, ptr %%t%zu\n", ctx->llvm_tmp + 1, llvm_types[size], ctx->llvm_tmp);
+		ctx->llvm_tmp += 2;
+		break;
+
+	case VAR_REGISTER:
+		part = get_reg_part(ctx, var, "llvm");
+		base = ctx->llvm_tmp;
+
+		fprintf(file, "\t%%t%zu = load i64, ptr %%%s\n", ctx->llvm_tmp++, part->base);
+
+		if (part->is_high)
+			fprintf(file, "\t%%t%zu = lshr i64 %%t%zu, 8\n", ctx->llvm_tmp++, base++);
+
+		if (size != CMD_QWORD)
+			fprintf(file, "\t%%t%zu = trunc i64 %%t%zu to %s\n", ctx->llvm_tmp++, base, llvm_types[size]);
+
+		break;
+
+	default:
+		unsupported_cmd(ctx, "llvm");
+	}
+
+	sprintf(value, "%%t%zu", ctx->llvm_tmp - 1);
+}
+
+static void llvm_write(struct bfc_ctx* ctx, struct var* var, enum cmd_size size, const char* value,
+		FILE* file)
+{
+	const struct reg_part* part;
+	uint64_t mask;
+
+	switch (var->type) {
+	case VAR_STACK:
+		fprintf(file, "\t%%t%zu = getelementptr inbounds %s, ptr @tape, i64 %zu\n",
+				ctx->llvm_tmp, llvm_types[ctx->cell_size], cell_index(ctx, var));
+		fprintf(file, "\tstore %s %s, ptr %%t%zu\n", llvm_types[size], value, ctx->llvm_tmp++);
+		break;
+
+	case VAR_REGISTER:
+		part = get_reg_part(ctx, var, "llvm");
+
+		if (size == CMD_QWORD) {
+			fprintf(file, "\tstore i64 %s, ptr %%%s\n", value, part->base);
+			break;
+		}
+
+		fprintf(file, "\t%%t%zu = zext %s %s to i64\n", ctx->llvm_tmp++, llvm_types[size], value);
+
+		if (size == CMD_DWORD) {
+			fprintf(file, "\tstore i64 %%t%zu, ptr %%%s\n", ctx->llvm_tmp - 1, part->base);
+			break;
+		}
+
+		if (part->is_high)
+			fprintf(file, "\t%%t%zu = shl i64 %%t%zu, 8\n", ctx->llvm_tmp, ctx->llvm_tmp - 1), ctx->llvm_tmp++;
+
+		mask = (((uint64_t) 1 << (8 << size)) - 1) << (part->is_high ? 8 : 0);
+
+		fprintf(file, "\t%%t%zu = load i64, ptr %%%s\n", ctx->llvm_tmp++, part->base);
+		fprintf(file, "\t%%t%zu = and i64 %%t%zu, %" PRIi64 "\n", ctx->llvm_tmp, ctx->llvm_tmp - 1,
+				(int64_t) ~mask);
+		ctx->llvm_tmp++;
+		fprintf(file, "\t%%t%zu = or i64 %%t%zu, %%t%zu\n", ctx->llvm_tmp, ctx->llvm_tmp - 1,
+				ctx->llvm_tmp - 3);
+		fprintf(file, "\tstore i64 %%t%zu, ptr %%%s\n", ctx->llvm_tmp++, part->base);
+		break;
+
+	default:
+		unsupported_cmd(ctx, "llvm");
+	}
+}
+
+static void llvm_binary(struct bfc_ctx* ctx, struct cmd* cmd, const char* op, FILE* file)
+{
+	char lhs[32], rhs[32], value[32];
+
+	llvm_read(ctx, cmd->arg1, cmd->size, lhs, file);
+	llvm_read(ctx, cmd->arg0, cmd->size, rhs, file);
+
+	fprintf(file, "\t%%t%zu = %s %s %s, %s\n", ctx->llvm_tmp, op, llvm_types[cmd->size], lhs, rhs);
+	sprintf(value, "%%t%zu", ctx->llvm_tmp++);
+
+	llvm_write(ctx, cmd->arg1, cmd->size, value, file);
+}
+
+static void create_llvm(struct bfc_ctx* ctx, FILE* file)
+{
+	char lhs[32], rhs[32];
+
+	fprintf(file,
+		"@tape = internal global [%zu x %s] zeroinitializer, align 16\n"
+		"\n"
+		"declare i32 @getchar()\n"
+		"declare i32 @putchar(i32)\n"
+		"declare void @exit(i32) noreturn\n"
+		"\n"
+		"define internal void @bf_syscall(i64 %%num, i64 %%arg0, i64 %%arg1) alwaysinline {\n"
+		"\tswitch i64 %%num, label %%done [ i64 0, label %%read\n"
+		"\t                                i64 1, label %%write\n"
+		"\t                                i64 60, label %%exit ]\n"
+		"read:\n"
+		"\t%%c = call i32 @getchar()\n"
+		"\t%%eof = icmp eq i32 %%c, -1\n"
+		"\tbr i1 %%eof, label %%done, label %%store\n"
+		"store:\n"
+		"\t%%in = inttoptr i64 %%arg1 to ptr\n"
+		"\t%%byte = trunc i32 %%c to i8\n"
+		"\tstore i8 %%byte, ptr %%in\n"
+		"\tbr label %%done\n"
+		"write:\n"
+		"\t%%out = inttoptr i64 %%arg1 to ptr\n"
+		"\t%%value = load i8, ptr %%out\n"
+		"\t%%wide = zext i8 %%value to i32\n"
+		"\tcall i32 @putchar(i32 %%wide)\n"
+		"\tbr label %%done\n"
+		"exit:\n"
+		"\t%%code = trunc i64 %%arg0 to i32\n"
+		"\tcall void @exit(i32 %%code)\n"
+		"\tunreachable\n"
+		"done:\n"
+		"\tret void\n"
+		"}\n"
+		"\n"
+		"define i32 @main() {\n",
+		ctx->tape_size / cell_bytes(ctx), llvm_types[ctx->cell_size]);
+
+	for (size_t i = 0; i < array_lenght(reg_parts); i++) {
+		if (reg_parts[i].base != NULL && reg_parts[i].size == CMD_QWORD)
+			fprintf(file, "\t%%%s = alloca i64\n\tstore i64 0, ptr %%%s\n",
+					reg_parts[i].base, reg_parts[i].base);
+	}
+
+	fprintf(file, "\t%%zf = alloca i1\n\t%%af = alloca i1\n"
+			"\tstore i1 0, ptr %%zf\n\tstore i1 0, ptr %%af\n");
+
+	for (int i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		switch (cmd->type) {
+		case CMD_ADD:
+			llvm_binary(ctx, cmd, "add", file);
+			break;
+
+		case CMD_SUB:
+			llvm_binary(ctx, cmd, "sub", file);
+			break;
+
+		case CMD_XOR:
+			llvm_binary(ctx, cmd, "xor", file);
+			break;
+
+		case CMD_IMUL:
+			llvm_binary(ctx, cmd, "mul", file);
+			break;
+
+		case CMD_MOV:
+			llvm_read(ctx, cmd->arg0, cmd->size, rhs, file);
+			llvm_write(ctx, cmd->arg1, cmd->size, rhs, file);
+			break;
+
+		case CMD_LEA:
+			fprintf(file, "\t%%t%zu = getelementptr inbounds %s, ptr @tape, i64 %zu\n",
+					ctx->llvm_tmp, llvm_types[ctx->cell_size], cell_index(ctx, cmd->arg0));
+			fprintf(file, "\t%%t%zu = ptrtoint ptr %%t%zu to i64\n", ctx->llvm_tmp + 1, ctx->llvm_tmp);
+			sprintf(rhs, "%%t%zu", ctx->llvm_tmp + 1);
+			ctx->llvm_tmp += 2;
+			llvm_write(ctx, cmd->arg1, CMD_QWORD, rhs, file);
+			break;
+
+		case CMD_CMP:
+			llvm_read(ctx, cmd->arg1, cmd->size, lhs, file);
+			llvm_read(ctx, cmd->arg0, cmd->size, rhs, file);
+			fprintf(file, "\t%%t%zu = icmp eq %s %s, %s\n", ctx->llvm_tmp, llvm_types[cmd->size], lhs, rhs);
+			fprintf(file, "\tstore i1 %%t%zu, ptr %%zf\n", ctx->llvm_tmp++);
+			fprintf(file, "\t%%t%zu = icmp ugt %s %s, %s\n", ctx->llvm_tmp, llvm_types[cmd->size], lhs, rhs);
+			fprintf(file, "\tstore i1 %%t%zu, ptr %%af\n", ctx->llvm_tmp++);
+			break;
+
+		case CMD_JE:
+		case CMD_JNE:
+		case CMD_JA:
+			fprintf(file, "\t%%t%zu = load i1, ptr %%%s\n", ctx->llvm_tmp, cmd->type == CMD_JA ? "af" : "zf");
+
+			if (cmd->type == CMD_JNE)
+				fprintf(file, "\tbr i1 %%t%zu, label %%n%zu, label %%%s\n", ctx->llvm_tmp, ctx->llvm_tmp,
+						cmd->arg0->value.str);
+			else
+				fprintf(file, "\tbr i1 %%t%zu, label %%%s, label %%n%zu\n", ctx->llvm_tmp,
+						cmd->arg0->value.str, ctx->llvm_tmp);
+
+			fprintf(file, "n%zu:\n", ctx->llvm_tmp++);
+			break;
+
+		case CMD_JMP:
+			fprintf(file, "\tbr label %%%s\n", cmd->arg0->value.str);
+			fprintf(file, "n%zu:\n", ctx->llvm_tmp++);
+			break;
+
+		case CMD_LABEL:
+			if (cmd->label->type == LABEL_GLOBL)
+				break;
+
+			fprintf(file, "\tbr label %%%s\n%s:\n", cmd->label->name, cmd->label->name);
+			break;
+
+		case CMD_SYSCALL:
+			fprintf(file, "\t%%t%zu = load i64, ptr %%rax\n", ctx->llvm_tmp);
+			fprintf(file, "\t%%t%zu = load i64, ptr %%rdi\n", ctx->llvm_tmp + 1);
+			fprintf(file, "\t%%t%zu = load i64, ptr %%rsi\n", ctx->llvm_tmp + 2);
+			fprintf(file, "\tcall void @bf_syscall(i64 %%t%zu, i64 %%t%zu, i64 %%t%zu)\n",
+					ctx->llvm_tmp, ctx->llvm_tmp + 1, ctx->llvm_tmp + 2);
+			ctx->llvm_tmp += 3;
+			break;
+
+		case CMD_EMPTY:
 			break;
+
+		default:
+			unsupported_cmd(ctx, "llvm");
 		}
 	}
+
+	fprintf(file, "\tret i32 0\n}\n");
 }
 
-static void apply_passes(void)
+static void apply_passes(struct bfc_ctx* ctx)
 {
 	bool is_optimized = true;
 
 	while (is_optimized) {
 		is_optimized = false;
 
-		for (int i = 0; i < pass_count; i++) {
-			pass_f pass = passes[i];
+		for (int i = 0; i < ctx->pass_count; i++) {
+			pass_f pass = ctx->passes[i];
 	
-			for (int j = 0; j < cmd_count; j++) {
-				struct cmd* cmd = &cmds[j];
-				is_optimized = pass(cmd) ? true : is_optimized;
+			for (int j = 0; j < ctx->cmd_count; j++) {
+				struct cmd* cmd = &ctx->cmds[j];
+				is_optimized = pass(ctx, cmd) ? true : is_optimized;
 			}
 		}
+
+		for (int i = 0; i < ctx->global_pass_count; i++)
+			is_optimized = ctx->global_passes[i](ctx) ? true : is_optimized;
 	}
 }
 
-static bool optimize_zero_mov_to_xor(struct cmd* cmd)
+static bool optimize_zero_mov_to_xor(struct bfc_ctx* ctx, struct cmd* cmd)
 {
+	(void) ctx;
+
 	if (cmd->type != CMD_MOV || cmd->arg0->type != VAR_CONST ||
 			cmd->arg0->value.value != 0 || cmd->arg1->type != VAR_REGISTER)
 		return false;
@@ -810,8 +2089,10 @@ static bool optimize_zero_mov_to_xor(struct cmd* cmd)
 	return true;
 }
 
-static bool optimize_move_regx_to_regx(struct cmd* cmd)
+static bool optimize_move_regx_to_regx(struct bfc_ctx* ctx, struct cmd* cmd)
 {
+	(void) ctx;
+
 	if (cmd->type != CMD_MOV || cmd->arg0->type != VAR_REGISTER || cmd->arg1->type != VAR_REGISTER ||
 			cmd->arg0->value.reg != cmd->arg1->value.reg)
 		return false;
@@ -823,48 +2104,2439 @@ static bool optimize_move_regx_to_regx(struct cmd* cmd)
 	return true;
 }
 
-static void add_passes(void)
+#define cmd_bit(x) (1u << (x))
+
+struct peephole_rule {
+	const char* name;
+
+	size_t window;
+	uint32_t pattern[MAX_PEEPHOLE_WINDOW];
+
+	bool (*check)(struct bfc_ctx* ctx, struct cmd** window);
+	void (*rewrite)(struct bfc_ctx* ctx, struct cmd** window);
+};
+
+static void clear_cmd(struct cmd* cmd)
 {
-	add_pass(optimize_zero_mov_to_xor);
-	add_pass(optimize_move_regx_to_regx);
+	cmd->type = CMD_EMPTY;
+	cmd->arg0 = NULL;
+	cmd->arg1 = NULL;
 }
 
-int main(int argc, char* argv[])
+static int64_t const_delta(struct cmd* cmd)
 {
-	const char* in_path  = NULL;
-	const char* out_path = NULL;
+	return cmd->type == CMD_SUB ? -const_value(cmd->arg0) : const_value(cmd->arg0);
+}
 
-	if (argc != 3)
-		return 1;
+static void set_const_delta(struct bfc_ctx* ctx, struct cmd* cmd, int64_t delta)
+{
+	cmd->type = delta < 0 ? CMD_SUB : CMD_ADD;
+	cmd->arg0 = add_var(ctx, &(struct var) { .type = VAR_CONST,
+			.value.value = wrap_value(delta < 0 ? -delta : delta, cmd->size) });
+}
+
+static bool check_same_dest_const(struct cmd** window)
+{
+	return window[0]->arg0->type == VAR_CONST && window[1]->arg0->type == VAR_CONST &&
+		window[0]->arg1 == window[1]->arg1 && window[0]->size == window[1]->size;
+}
+
+static bool check_fold_add_sub(struct bfc_ctx* ctx, struct cmd** window)
+{
+	(void) ctx;
+
+	if (!check_same_dest_const(window))
+		return false;
+
+	int64_t delta = const_delta(window[0]) + const_delta(window[1]);
+
+	return fits_imm_size(window[0]->size, wrap_value(delta < 0 ? -delta : delta, window[0]->size));
+}
+
+static bool check_fold_mov_add(struct bfc_ctx* ctx, struct cmd** window)
+{
+	(void) ctx;
+
+	if (!check_same_dest_const(window))
+		return false;
+
+	int64_t value = const_value(window[0]->arg0) + const_delta(window[1]);
+
+	return fits_imm_size(window[0]->size, wrap_value(value, window[0]->size));
+}
+
+static void rewrite_fold_add_sub(struct bfc_ctx* ctx, struct cmd** window)
+{
+	int64_t delta = const_delta(window[0]) + const_delta(window[1]);
+
+	clear_cmd(window[1]);
+
+	if (wrap_value(delta, window[0]->size) == 0)
+		clear_cmd(window[0]);
+	else
+		set_const_delta(ctx, window[0], delta);
+}
+
+static void rewrite_fold_mov_add(struct bfc_ctx* ctx, struct cmd** window)
+{
+	int64_t value = const_value(window[0]->arg0) + const_delta(window[1]);
+
+	window[0]->arg0 = add_var(ctx, &(struct var) { .type = VAR_CONST,
+			.value.value = wrap_value(value, window[0]->size) });
+	clear_cmd(window[1]);
+}
+
+static bool check_overwritten_mov(struct bfc_ctx* ctx, struct cmd** window)
+{
+	(void) ctx;
+
+	return window[0]->arg1 == window[1]->arg1 && window[1]->arg0 != window[1]->arg1 &&
+		window[0]->size == window[1]->size;
+}
+
+static void rewrite_drop_first(struct bfc_ctx* ctx, struct cmd** window)
+{
+	(void) ctx;
+
+	clear_cmd(window[0]);
+}
+
+static bool check_zero_update(struct bfc_ctx* ctx, struct cmd** window)
+{
+	(void) ctx;
+
+	return window[0]->arg0->type == VAR_CONST &&
+		wrap_value(const_value(window[0]->arg0), window[0]->size) == 0;
+}
+
+static bool check_loop_after_loop(struct bfc_ctx* ctx, struct cmd** window)
+{
+	(void) ctx;
+
+	return window[0]->label->name[0] == 'E' && window[1]->label->name[0] == 'B' &&
+		window[0]->label->cell != NULL && window[0]->label->cell == window[1]->label->cell;
+}
+
+static size_t find_loop_end(struct bfc_ctx* ctx, size_t start)
+{
+	const char* suffix = ctx->cmds[start].label->name + 1;
+
+	for (size_t i = start + 1; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		if (cmd->type == CMD_LABEL && cmd->label->name[0] == 'E' &&
+				strcmp(cmd->label->name + 1, suffix) == 0)
+			return i;
+	}
+
+	return ctx->cmd_count - 1;
+}
+
+static void rewrite_drop_loop(struct bfc_ctx* ctx, struct cmd** window)
+{
+	size_t start = window[1] - ctx->cmds;
+	size_t end   = find_loop_end(ctx, start);
+
+	for (size_t i = start; i <= end; i++)
+		clear_cmd(&ctx->cmds[i]);
+}
+
+static const struct peephole_rule peephole_rules[] = {
+	{
+		.name    = "fold-add-sub",
+		.window  = 2,
+		.pattern = { cmd_bit(CMD_ADD) | cmd_bit(CMD_SUB), cmd_bit(CMD_ADD) | cmd_bit(CMD_SUB) },
+		.check   = check_fold_add_sub,
+		.rewrite = rewrite_fold_add_sub,
+	},
+	{
+		.name    = "fold-mov-add",
+		.window  = 2,
+		.pattern = { cmd_bit(CMD_MOV), cmd_bit(CMD_ADD) | cmd_bit(CMD_SUB) },
+		.check   = check_fold_mov_add,
+		.rewrite = rewrite_fold_mov_add,
+	},
+	{
+		.name    = "drop-overwritten-mov",
+		.window  = 2,
+		.pattern = { cmd_bit(CMD_MOV), cmd_bit(CMD_MOV) },
+		.check   = check_overwritten_mov,
+		.rewrite = rewrite_drop_first,
+	},
+	{
+		.name    = "drop-zero-add-sub",
+		.window  = 1,
+		.pattern = { cmd_bit(CMD_ADD) | cmd_bit(CMD_SUB) },
+		.check   = check_zero_update,
+		.rewrite = rewrite_drop_first,
+	},
+	{
+		.name    = "drop-loop-after-loop",
+		.window  = 2,
+		.pattern = { cmd_bit(CMD_LABEL), cmd_bit(CMD_LABEL) },
+		.check   = check_loop_after_loop,
+		.rewrite = rewrite_drop_loop,
+	},
+};
+
+static size_t collect_window(struct bfc_ctx* ctx, size_t start, struct cmd** window)
+{
+	size_t count = 0;
+
+	for (size_t i = start; i < ctx->cmd_count && count < MAX_PEEPHOLE_WINDOW; i++) {
+		if (ctx->cmds[i].type == CMD_EMPTY)
+			continue;
+
+		window[count++] = &ctx->cmds[i];
+	}
+
+	return count;
+}
+
+static bool match_rule(struct bfc_ctx* ctx, const struct peephole_rule* rule, struct cmd** window,
+		size_t count)
+{
+	if (rule->window > count)
+		return false;
+
+	for (size_t i = 0; i < rule->window; i++) {
+		if ((rule->pattern[i] & cmd_bit(window[i]->type)) == 0)
+			return false;
+	}
+
+	return rule->check(ctx, window);
+}
+
+static bool optimize_peephole(struct bfc_ctx* ctx)
+{
+	struct cmd* window[MAX_PEEPHOLE_WINDOW];
+	bool is_optimized = false;
+
+	for (size_t i = 0; i < ctx->cmd_count; i++) {
+		if (ctx->cmds[i].type == CMD_EMPTY)
+			continue;
+
+		size_t count = collect_window(ctx, i, window);
+
+		for (size_t j = 0; j < array_lenght(peephole_rules); j++) {
+			const struct peephole_rule* rule = &peephole_rules[j];
+
+			if (!match_rule(ctx, rule, window, count))
+				continue;
+
+			rule->rewrite(ctx, window);
+			ctx->peephole_hits[j]++;
+
+			is_optimized = true;
+			break;
+		}
+	}
+
+	return is_optimized;
+}
+
+struct vec_lane {
+	bool touched;
+	bool cleared;
+	int64_t delta;
+};
+
+static bool is_cell_update(struct bfc_ctx* ctx, struct cmd* cmd)
+{
+	return (cmd->type == CMD_ADD || cmd->type == CMD_SUB || cmd->type == CMD_MOV) &&
+		cmd->arg0->type == VAR_CONST && is_cell(ctx, cmd->arg1);
+}
+
+static void update_lane(struct vec_lane* lane, struct cmd* cmd)
+{
+	lane->touched = true;
+
+	if (cmd->type == CMD_MOV) {
+		lane->cleared = true;
+		lane->delta   = const_value(cmd->arg0);
+	} else {
+		lane->delta += const_delta(cmd);
+	}
+}
+
+static void put_lane(struct bfc_ctx* ctx, struct var* vec, size_t lane, uint64_t value)
+{
+	for (size_t i = 0; i < cell_bytes(ctx); i++)
+		vec->value.str[lane * cell_bytes(ctx) + i] = (char) (value >> (i * 8));
+}
+
+static size_t compact_segment(struct bfc_ctx* ctx, size_t start, size_t end)
+{
+	size_t to = start;
+
+	for (size_t i = start; i < end; i++) {
+		if (ctx->cmds[i].type != CMD_EMPTY)
+			ctx->cmds[to++] = ctx->cmds[i];
+	}
+
+	for (size_t i = to; i < end; i++)
+		clear_cmd(&ctx->cmds[i]);
+
+	return to;
+}
+
+static size_t lower_vec_window(struct bfc_ctx* ctx, size_t start, size_t end, size_t first_cell)
+{
+	size_t lane_count = vec_bytes(ctx) / cell_bytes(ctx);
+	struct vec_lane lanes[MAX_VEC_BYTES] = {0};
+	size_t touched = 0;
+	bool any_clear = false, any_delta = false;
+
+	if ((first_cell + lane_count) * cell_bytes(ctx) > ctx->tape_size)
+		return 0;
+
+	for (size_t i = start; i < end; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		if (cmd->type == CMD_EMPTY)
+			continue;
+
+		size_t cell = cell_index(ctx, cmd->arg1);
+		if (cell < first_cell || cell >= first_cell + lane_count)
+			continue;
+
+		struct vec_lane* lane = &lanes[cell - first_cell];
+		touched += lane->touched ? 0 : 1;
+		update_lane(lane, cmd);
+	}
+
+	if (touched < MIN_VEC_CELLS)
+		return 0;
+
+	struct var* mask  = add_var(ctx, &(struct var) { .type = VAR_CONST_VEC });
+	struct var* delta = add_var(ctx, &(struct var) { .type = VAR_CONST_VEC });
+
+	for (size_t i = 0; i < lane_count; i++) {
+		put_lane(ctx, mask, i, lanes[i].cleared ? 0 : UINT64_MAX);
+		put_lane(ctx, delta, i, (uint64_t) lanes[i].delta);
+
+		any_clear = lanes[i].cleared ? true : any_clear;
+		any_delta = wrap_value(lanes[i].delta, ctx->cell_size) != 0 ? true : any_delta;
+	}
+
+	for (size_t i = start; i < end; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		if (cmd->type == CMD_EMPTY)
+			continue;
+
+		size_t cell = cell_index(ctx, cmd->arg1);
+		if (cell >= first_cell && cell < first_cell + lane_count)
+			clear_cmd(cmd);
+	}
+
+	size_t free_slot = compact_segment(ctx, start, end);
+
+	struct var* base = &ctx->bf_vars[first_cell];
+	struct var* xmm0 = add_var(ctx, &(struct var) { .type = VAR_REGISTER, .value.reg = vec_reg(ctx) });
+
+	if (base->type == VAR_PROG)
+		dispence_with_stack(ctx, base);
+
+#	define put_cmd(...) ctx->cmds[free_slot++] = (struct cmd) { __VA_ARGS__ }
+
+	put_cmd(.type = CMD_MOVDQU, .arg0 = base, .arg1 = xmm0);
+	if (any_clear) put_cmd(.type = CMD_PAND, .arg0 = mask, .arg1 = xmm0);
+	if (any_delta) put_cmd(.type = CMD_PADD, .size = ctx->cell_size, .arg0 = delta, .arg1 = xmm0);
+	put_cmd(.type = CMD_MOVDQU, .arg0 = xmm0, .arg1 = base);
+
+#	undef put_cmd
+
+	return touched;
+}
+
+static void lower_vec_segment(struct bfc_ctx* ctx, size_t start, size_t end)
+{
+	size_t cell = SIZE_MAX;
+
+	for (;;) {
+		size_t next = SIZE_MAX;
+
+		for (size_t i = start; i < end; i++) {
+			struct cmd* cmd = &ctx->cmds[i];
+
+			if (is_cell_update(ctx, cmd) && (cell == SIZE_MAX || cell_index(ctx, cmd->arg1) > cell) &&
+					cell_index(ctx, cmd->arg1) < next)
+				next = cell_index(ctx, cmd->arg1);
+		}
+
+		if (next == SIZE_MAX)
+			break;
+
+		cell = lower_vec_window(ctx, start, end, next) != 0 ?
+			next + vec_bytes(ctx) / cell_bytes(ctx) - 1 : next;
+	}
+}
+
+static void lower_vec(struct bfc_ctx* ctx)
+{
+	size_t start = 0;
+
+	for (size_t i = 0; i <= ctx->cmd_count; i++) {
+		if (i < ctx->cmd_count && (ctx->cmds[i].type == CMD_EMPTY || is_cell_update(ctx, &ctx->cmds[i])))
+			continue;
+
+		if (i - start >= MIN_VEC_CELLS)
+			lower_vec_segment(ctx, start, i);
+
+		start = i + 1;
+	}
+}
+
+static uint64_t cell_mask(struct bfc_ctx* ctx)
+{
+	return ctx->cell_size == CMD_QWORD ? UINT64_MAX : ((uint64_t) 1 << (cell_bytes(ctx) * 8)) - 1;
+}
+
+static uint64_t imm_value(struct bfc_ctx* ctx, struct var* var)
+{
+	return (uint64_t) const_value(var) & cell_mask(ctx);
+}
+
+static size_t next_cmd(struct bfc_ctx* ctx, size_t i)
+{
+	for (i++; i < ctx->cmd_count && ctx->cmds[i].type == CMD_EMPTY; i++);
+	return i;
+}
+
+static size_t prev_cmd(struct bfc_ctx* ctx, size_t i)
+{
+	for (i--; i > 0 && ctx->cmds[i].type == CMD_EMPTY; i--);
+	return i;
+}
+
+static bool is_input(struct bfc_ctx* ctx, size_t i)
+{
+	for (i++; i < ctx->cmd_count && ctx->cmds[i].type != CMD_SYSCALL; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		if (cmd->type == CMD_MOV && cmd->arg0->type == VAR_CONST && cmd->arg0->value.value == 0 &&
+				cmd->arg1->type == VAR_REGISTER && cmd->arg1->value.reg == REG_RAX)
+			return true;
+
+		if (cmd->type == CMD_XOR && cmd->arg1->type == VAR_REGISTER && cmd->arg1->value.reg == REG_RAX)
+			return true;
+	}
+
+	return false;
+}
+
+static struct var* written_cell(struct bfc_ctx* ctx, size_t i)
+{
+	struct cmd* cmd = &ctx->cmds[i];
+
+	switch (cmd->type) {
+	case CMD_ADD:
+	case CMD_SUB:
+	case CMD_MOV:
+	case CMD_XOR:
+		return is_cell(ctx, cmd->arg1) ? cmd->arg1 : NULL;
+
+	case CMD_LEA:
+		return is_cell(ctx, cmd->arg0) && is_input(ctx, i) ? cmd->arg0 : NULL;
+
+	default:
+		return NULL;
+	}
+}
+
+static void reset_cell_states(struct bfc_ctx* ctx, enum cell_fact fact)
+{
+	for (size_t i = 0; i < ctx->cell_count; i++)
+		ctx->cell_states[i] = (struct cell_state) { .fact = fact, .value = 0 };
+}
+
+static void step_cell_state(struct bfc_ctx* ctx, size_t i)
+{
+	struct cmd* cmd   = &ctx->cmds[i];
+	struct var* cell  = written_cell(ctx, i);
+
+	if (cell == NULL)
+		return;
+
+	struct cell_state* state = &ctx->cell_states[cell_index(ctx, cell)];
+
+	if (cmd->arg0 == NULL || cmd->arg0->type != VAR_CONST || cmd->type == CMD_LEA) {
+		state->fact = FACT_UNKNOWN;
+		return;
+	}
+
+	switch (cmd->type) {
+	case CMD_MOV:
+		*state = (struct cell_state) { .fact = FACT_CONST, .value = imm_value(ctx, cmd->arg0) };
+		break;
+
+	case CMD_ADD:
+	case CMD_SUB:
+		if (state->fact != FACT_CONST) {
+			state->fact = FACT_UNKNOWN;
+			break;
+		}
+
+		state->value = (cmd->type == CMD_ADD ? state->value + imm_value(ctx, cmd->arg0) :
+				state->value - imm_value(ctx, cmd->arg0)) & cell_mask(ctx);
+		break;
+
+	default:
+		state->fact = FACT_UNKNOWN;
+		break;
+	}
+}
+
+static void kill_loop_writes(struct bfc_ctx* ctx, size_t start, size_t end)
+{
+	for (size_t i = start; i <= end; i++) {
+		struct var* cell = written_cell(ctx, i);
+
+		if (cell != NULL)
+			ctx->cell_states[cell_index(ctx, cell)].fact = FACT_UNKNOWN;
+	}
+}
+
+static bool is_known_zero(struct bfc_ctx* ctx, struct var* cell)
+{
+	struct cell_state* state = &ctx->cell_states[cell_index(ctx, cell)];
+	return state->fact == FACT_CONST && state->value == 0;
+}
+
+static bool is_known_nonzero(struct bfc_ctx* ctx, struct var* cell)
+{
+	struct cell_state* state = &ctx->cell_states[cell_index(ctx, cell)];
+	return state->fact == FACT_NONZERO || (state->fact == FACT_CONST && state->value != 0);
+}
+
+static bool is_loop_test(struct bfc_ctx* ctx, size_t start, size_t end, size_t* test)
+{
+	for (size_t i = 0, j = start; i < 3; i++) {
+		j = next_cmd(ctx, j);
+		if (j >= end)
+			return false;
+
+		test[i] = j;
+	}
+
+	return ctx->cmds[test[0]].type == CMD_MOV && ctx->cmds[test[0]].arg0 == ctx->cmds[start].label->cell &&
+		ctx->cmds[test[1]].type == CMD_CMP && ctx->cmds[test[2]].type == CMD_JE;
+}
+
+static bool rotate_loop(struct bfc_ctx* ctx, size_t start, size_t end)
+{
+	size_t test[3];
+	size_t jmp = prev_cmd(ctx, end);
+
+	if (!is_loop_test(ctx, start, end, test) || ctx->cmds[jmp].type != CMD_JMP)
+		return false;
+
+	struct cmd load = ctx->cmds[test[0]];
+	struct cmd cmp  = ctx->cmds[test[1]];
+	struct var* head = add_var(ctx, &(struct var) { .type = VAR_LABEL });
+	strcpy(head->value.str, ctx->cmds[start].label->name);
+
+	size_t out = start + 1;
+
+	for (size_t i = test[2] + 1; i < jmp; i++) {
+		if (ctx->cmds[i].type != CMD_EMPTY)
+			ctx->cmds[out++] = ctx->cmds[i];
+	}
+
+	ctx->cmds[out++] = load;
+	ctx->cmds[out++] = cmp;
+	ctx->cmds[out++] = (struct cmd) { .type = CMD_JNE, .arg0 = head };
+
+	while (out < end)
+		clear_cmd(&ctx->cmds[out++]);
+
+	return true;
+}
+
+struct loop_update {
+	struct var* cell;
+	uint64_t delta;
+};
+
+struct counted_loop {
+	size_t first;
+	size_t last;
+	size_t size;
+
+	uint64_t step;
+	bool is_pure;
+
+	struct loop_update updates[MAX_UNROLL_CMDS];
+	size_t update_count;
+};
+
+static uint64_t update_delta(struct bfc_ctx* ctx, struct cmd* cmd)
+{
+	return (cmd->type == CMD_SUB ? -imm_value(ctx, cmd->arg0) : imm_value(ctx, cmd->arg0)) & cell_mask(ctx);
+}
+
+static bool fits_imm(struct bfc_ctx* ctx, uint64_t value)
+{
+	return fits_imm_size(ctx->cell_size, value);
+}
+
+static bool loop_body(struct bfc_ctx* ctx, size_t start, size_t end, size_t* first, size_t* last)
+{
+	size_t test[3];
+
+	if (is_loop_test(ctx, start, end, test)) {
+		*first = test[2] + 1;
+		*last  = prev_cmd(ctx, end);
+
+		return ctx->cmds[*last].type == CMD_JMP;
+	}
+
+	*first = start + 1;
+	*last  = prev_cmd(ctx, end);
+
+	if (ctx->cmds[*last].type != CMD_JNE)
+		return false;
+
+	*last = prev_cmd(ctx, prev_cmd(ctx, *last));
+
+	return ctx->cmds[*last].type == CMD_MOV && ctx->cmds[*last].arg0 == ctx->cmds[start].label->cell;
+}
+
+static bool analyse_counted_loop(struct bfc_ctx* ctx, size_t start, size_t end,
+		struct counted_loop* loop)
+{
+	struct var* cell = ctx->cmds[start].label->cell;
+
+	if (!loop_body(ctx, start, end, &loop->first, &loop->last))
+		return false;
+
+	loop->size         = 0;
+	loop->step         = 0;
+	loop->is_pure      = true;
+	loop->update_count = 0;
+
+	for (size_t i = loop->first; i < loop->last; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		if (cmd->type == CMD_EMPTY)
+			continue;
+
+		if (cmd->type == CMD_LABEL || ++loop->size > MAX_UNROLL_CMDS)
+			return false;
+
+		bool is_update = is_cell_update(ctx, cmd) && cmd->type != CMD_MOV;
+
+		if (written_cell(ctx, i) == cell) {
+			if (!is_update)
+				return false;
+
+			loop->step = (loop->step + update_delta(ctx, cmd)) & cell_mask(ctx);
+			continue;
+		}
+
+		if (!is_update) {
+			loop->is_pure = false;
+			continue;
+		}
+
+		size_t j;
+		for (j = 0; j < loop->update_count && loop->updates[j].cell != cmd->arg1; j++);
+
+		if (j == loop->update_count)
+			loop->updates[loop->update_count++] = (struct loop_update) { .cell = cmd->arg1 };
+
+		loop->updates[j].delta = (loop->updates[j].delta + update_delta(ctx, cmd)) & cell_mask(ctx);
+	}
+
+	return loop->step == 1 || loop->step == cell_mask(ctx);
+}
+
+static void defer_region(struct bfc_ctx* ctx, size_t start, size_t end, const struct cmd* cmds,
+		size_t count)
+{
+	if (ctx->deferred_count == ctx->deferred_capacity) {
+		size_t capacity = ctx->deferred_capacity == 0 ? 64 : ctx->deferred_capacity * 2;
+		struct deferred_region* deferred = realloc(ctx->deferred, capacity * sizeof(*deferred));
+		if (deferred == NULL)
+			compile_error(ctx, "out of memory");
+
+		ctx->deferred          = deferred;
+		ctx->deferred_capacity = capacity;
+	}
+
+	if (ctx->deferred_cmd_count + count > ctx->deferred_cmd_capacity) {
+		size_t capacity = ctx->deferred_cmd_capacity == 0 ? 1024 : ctx->deferred_cmd_capacity;
+		while (capacity < ctx->deferred_cmd_count + count)
+			capacity *= 2;
+
+		struct cmd* deferred_cmds = realloc(ctx->deferred_cmds, capacity * sizeof(struct cmd));
+		if (deferred_cmds == NULL)
+			compile_error(ctx, "out of memory");
+
+		ctx->deferred_cmds         = deferred_cmds;
+		ctx->deferred_cmd_capacity = capacity;
+	}
+
+	memcpy(&ctx->deferred_cmds[ctx->deferred_cmd_count], cmds, count * sizeof(struct cmd));
+	ctx->deferred[ctx->deferred_count++] = (struct deferred_region) { .start = start, .end = end,
+		.offset = ctx->deferred_cmd_count, .count = count };
+	ctx->deferred_cmd_count += count;
+}
+
+static bool is_deferred(struct bfc_ctx* ctx, size_t start, size_t end)
+{
+	if (ctx->deferred_count == 0)
+		return false;
+
+	struct deferred_region* last = &ctx->deferred[ctx->deferred_count - 1];
+
+	return last->start >= start && last->start <= end;
+}
+
+static void apply_deferred(struct bfc_ctx* ctx)
+{
+	size_t count = ctx->cmd_count;
+
+	if (ctx->deferred_count == 0)
+		return;
+
+	for (size_t i = 0; i < ctx->deferred_count; i++)
+		count += ctx->deferred[i].count - (ctx->deferred[i].end + 1 - ctx->deferred[i].start);
+
+	struct cmd* cmds = reserve_scratch(ctx, count);
+	size_t pos = 0, done = 0;
+
+	for (size_t i = 0; i < ctx->deferred_count; i++) {
+		struct deferred_region* region = &ctx->deferred[i];
+
+		memcpy(&cmds[done], &ctx->cmds[pos], (region->start - pos) * sizeof(struct cmd));
+		done += region->start - pos;
+
+		memcpy(&cmds[done], &ctx->deferred_cmds[region->offset], region->count * sizeof(struct cmd));
+		done += region->count;
+		pos   = region->end + 1;
+	}
+
+	memcpy(&cmds[done], &ctx->cmds[pos], (ctx->cmd_count - pos) * sizeof(struct cmd));
+
+	ctx->scratch_cmds     = ctx->cmds;
+	ctx->scratch_capacity = ctx->cmd_capacity;
+	ctx->cmds             = cmds;
+	ctx->cmd_count        = count;
+	ctx->cmd_capacity     = count;
+
+	ctx->deferred_count     = 0;
+	ctx->deferred_cmd_count = 0;
+}
+
+static bool replace_region(struct bfc_ctx* ctx, size_t start, size_t end, size_t count)
+{
+	size_t length = end - start + 1;
+
+	if (count > length) {
+		defer_region(ctx, start, end, ctx->region_buf, count);
+		return true;
+	}
+
+	memcpy(&ctx->cmds[start], ctx->region_buf, count * sizeof(struct cmd));
+
+	for (size_t i = start + count; i <= end; i++)
+		clear_cmd(&ctx->cmds[i]);
+
+	return true;
+}
+
+static struct var* add_cell_const(struct bfc_ctx* ctx, uint64_t value)
+{
+	return add_var(ctx, &(struct var) { .type = VAR_CONST, .value.value = value });
+}
+
+static bool lower_closed_form(struct bfc_ctx* ctx, size_t start, size_t end, struct counted_loop* loop,
+		uint64_t trip)
+{
+	struct var* cell = ctx->cmds[start].label->cell;
+	size_t count = 0;
+
+	for (size_t i = 0; i < loop->update_count; i++) {
+		uint64_t delta = loop->updates[i].delta * trip & cell_mask(ctx);
+
+		if (!fits_imm(ctx, delta))
+			return false;
+
+		if (delta != 0)
+			ctx->region_buf[count++] = (struct cmd) { .type = CMD_ADD, .size = ctx->cell_size,
+					.arg0 = add_cell_const(ctx, delta), .arg1 = loop->updates[i].cell };
+	}
+
+	ctx->region_buf[count++] = (struct cmd) { .type = CMD_MOV, .size = ctx->cell_size,
+			.arg0 = add_cell_const(ctx, 0), .arg1 = cell };
+
+	return replace_region(ctx, start, end, count);
+}
+
+static bool lower_multiply(struct bfc_ctx* ctx, size_t start, size_t end, struct counted_loop* loop)
+{
+	static const enum reg acc_regs[] = { REG_AL, REG_AX, REG_EAX, REG_RAX };
+	static const enum reg mul_regs[] = { REG_DL, REG_DX, REG_EDX, REG_RDX };
+
+	struct var* cell = ctx->cmds[start].label->cell;
+	enum cmd_size wide = ctx->cell_size == CMD_QWORD ? CMD_QWORD : CMD_DWORD;
+	size_t count = 0;
+
+	if (loop->size * 3 + 2 > MAX_UNROLL_CMDS)
+		return false;
+
+	struct var* acc      = add_reg(ctx, acc_regs[ctx->cell_size]);
+	struct var* wide_acc = add_reg(ctx, wide == CMD_QWORD ? REG_RAX : REG_EAX);
+	struct var* wide_mul = add_reg(ctx, wide == CMD_QWORD ? REG_RDX : REG_EDX);
+	struct var* mul      = add_reg(ctx, mul_regs[ctx->cell_size]);
+
+	ctx->region_buf[count++] = (struct cmd) { .type = CMD_MOV, .size = ctx->cell_size, .arg0 = cell,
+		.arg1 = acc };
+
+	for (size_t i = 0; i < loop->update_count; i++) {
+		uint64_t factor = loop->step == 1 ? -loop->updates[i].delta & cell_mask(ctx) : loop->updates[i].delta;
+		struct var* target = loop->updates[i].cell;
+
+		if (factor == 0)
+			continue;
+
+		if (factor == 1 || factor == cell_mask(ctx)) {
+			ctx->region_buf[count++] = (struct cmd) { .type = factor == 1 ? CMD_ADD : CMD_SUB,
+					.size = ctx->cell_size, .arg0 = acc, .arg1 = target };
+			continue;
+		}
+
+		if (!fits_imm(ctx, factor))
+			return false;
+
+		ctx->region_buf[count++] = (struct cmd) { .type = CMD_MOV, .size = wide, .arg0 = wide_acc,
+				.arg1 = wide_mul };
+		ctx->region_buf[count++] = (struct cmd) { .type = CMD_IMUL, .size = wide,
+				.arg0 = add_cell_const(ctx, factor), .arg1 = wide_mul };
+		ctx->region_buf[count++] = (struct cmd) { .type = CMD_ADD, .size = ctx->cell_size, .arg0 = mul,
+				.arg1 = target };
+	}
+
+	ctx->region_buf[count++] = (struct cmd) { .type = CMD_MOV, .size = ctx->cell_size,
+			.arg0 = add_cell_const(ctx, 0), .arg1 = cell };
+
+	return replace_region(ctx, start, end, count);
+}
+
+static size_t copy_body(struct bfc_ctx* ctx, struct counted_loop* loop, size_t copies)
+{
+	size_t count = 0;
+
+	for (size_t n = 0; n < copies; n++) {
+		for (size_t i = loop->first; i < loop->last; i++) {
+			if (ctx->cmds[i].type != CMD_EMPTY)
+				ctx->region_buf[count++] = ctx->cmds[i];
+		}
+	}
+
+	return count;
+}
+
+static bool unroll_loop(struct bfc_ctx* ctx, size_t start, size_t end, struct counted_loop* loop,
+		uint64_t trip)
+{
+	if (trip * loop->size > MAX_UNROLL_CMDS)
+		return false;
+
+	return replace_region(ctx, start, end, copy_body(ctx, loop, trip));
+}
+
+static bool partially_unroll_loop(struct bfc_ctx* ctx, struct counted_loop* loop, uint64_t trip)
+{
+	size_t factor;
+
+	for (factor = MAX_PARTIAL_UNROLL; factor > 1; factor /= 2) {
+		if (trip % factor == 0 && loop->size * factor <= MAX_UNROLL_CMDS)
+			break;
+	}
+
+	if (factor == 1)
+		return false;
+
+	size_t count = copy_body(ctx, loop, factor);
+
+	defer_region(ctx, loop->last, loop->last - 1, ctx->region_buf + loop->size, count - loop->size);
+
+	return true;
+}
+
+static bool optimize_counted_loop(struct bfc_ctx* ctx, size_t start, size_t end)
+{
+	struct var* cell = ctx->cmds[start].label->cell;
+	struct cell_state* state = &ctx->cell_states[cell_index(ctx, cell)];
+	struct counted_loop loop;
+
+	if (!analyse_counted_loop(ctx, start, end, &loop))
+		return false;
+
+	if (state->fact != FACT_CONST) {
+		if (!loop.is_pure || !lower_multiply(ctx, start, end, &loop))
+			return false;
+
+		ctx->counted_loops++;
+		return true;
+	}
+
+	uint64_t trip = (loop.step == 1 ? -state->value : state->value) & cell_mask(ctx);
+
+	if (loop.is_pure && lower_closed_form(ctx, start, end, &loop, trip)) {
+		ctx->counted_loops++;
+		return true;
+	}
+
+	if (unroll_loop(ctx, start, end, &loop, trip)) {
+		ctx->unrolled_loops++;
+		return true;
+	}
+
+	if (!partially_unroll_loop(ctx, &loop, trip))
+		return false;
+
+	ctx->partially_unrolled_loops++;
+	return true;
+}
+
+static bool optimize_dead_stores(struct bfc_ctx* ctx)
+{
+	bool* is_read     = ctx->is_read;
+	bool is_optimized = false;
+
+	memset(is_read, 0, ctx->cell_count * sizeof(bool));
+
+	for (size_t i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		if (cmd->arg0 != NULL && is_cell(ctx, cmd->arg0))
+			is_read[cell_index(ctx, cmd->arg0)] = true;
+	}
+
+	for (size_t i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		if (!is_cell_update(ctx, cmd) || is_read[cell_index(ctx, cmd->arg1)])
+			continue;
+
+		clear_cmd(cmd);
+		ctx->removed_stores++;
+		is_optimized = true;
+	}
+
+	return is_optimized;
+}
+
+static bool optimize_value_range(struct bfc_ctx* ctx)
+{
+	size_t loop_starts[MAX_LEVEL_COUNT];
+	size_t depth = 0;
+	bool is_optimized = !ctx->is_region && !ctx->embed && optimize_dead_stores(ctx);
+
+	reset_cell_states(ctx, ctx->has_prolouge ? FACT_CONST : FACT_UNKNOWN);
+
+	for (size_t i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+		size_t test[3];
+
+		if (cmd->type != CMD_LABEL) {
+			step_cell_state(ctx, i);
+			continue;
+		}
+
+		struct var* cell = cmd->label->cell;
+
+		if (cell == NULL) {
+			if (cmd->label->type != LABEL_GLOBL)
+				reset_cell_states(ctx, FACT_UNKNOWN);
+
+			continue;
+		}
+
+		if (cmd->label->name[0] == 'E') {
+			kill_loop_writes(ctx, loop_starts[--depth], i);
+			ctx->cell_states[cell_index(ctx, cell)] = (struct cell_state) { .fact = FACT_CONST, .value = 0 };
+			continue;
+		}
+
+		size_t end = find_loop_end(ctx, i);
+
+		if (!is_known_zero(ctx, cell) && optimize_counted_loop(ctx, i, end)) {
+			is_optimized = true;
+
+			if (!is_deferred(ctx, i, end)) {
+				i--;
+				continue;
+			}
+
+			kill_loop_writes(ctx, i, end);
+			ctx->cell_states[cell_index(ctx, cell)] = (struct cell_state) { .fact = FACT_CONST, .value = 0 };
+			i = end;
+			continue;
+		}
+
+		end = find_loop_end(ctx, i);
+
+		if (is_known_zero(ctx, cell)) {
+			for (size_t j = i; j <= end; j++)
+				clear_cmd(&ctx->cmds[j]);
+
+			i = end;
+			ctx->removed_loops++;
+			is_optimized = true;
+			continue;
+		}
+
+		if (is_known_nonzero(ctx, cell) && rotate_loop(ctx, i, end)) {
+			ctx->rotated_loops++;
+			is_optimized = true;
+		}
+
+		kill_loop_writes(ctx, i, end);
+		loop_starts[depth++] = i;
+
+		ctx->cell_states[cell_index(ctx, cell)].fact = FACT_NONZERO;
+
+		if (is_loop_test(ctx, i, end, test))
+			i = test[2];
+	}
+
+	apply_deferred(ctx);
+
+	return is_optimized;
+}
+
+static void print_stats(struct bfc_ctx* ctx, FILE* file)
+{
+	for (size_t i = 0; i < array_lenght(peephole_rules); i++)
+		fprintf(file, "bfc1: peephole %s: %zu\n", peephole_rules[i].name, ctx->peephole_hits[i]);
+
+	fprintf(file, "bfc1: value-range removed-loops: %zu\n", ctx->removed_loops);
+	fprintf(file, "bfc1: value-range rotated-loops: %zu\n", ctx->rotated_loops);
+	fprintf(file, "bfc1: value-range removed-stores: %zu\n", ctx->removed_stores);
+	fprintf(file, "bfc1: counted-loops closed-form: %zu\n", ctx->counted_loops);
+	fprintf(file, "bfc1: counted-loops unrolled: %zu\n", ctx->unrolled_loops);
+	fprintf(file, "bfc1: counted-loops partially-unrolled: %zu\n", ctx->partially_unrolled_loops);
+
+	if (ctx->cache_dir != NULL) {
+		fprintf(file, "bfc1: region-cache hits: %zu\n", ctx->cache_hits);
+		fprintf(file, "bfc1: region-cache misses: %zu\n", ctx->cache_misses);
+	}
+}
+
+static void add_passes(struct bfc_ctx* ctx)
+{
+	add_pass(ctx, optimize_zero_mov_to_xor);
+	add_pass(ctx, optimize_move_regx_to_regx);
+
+	add_global_pass(ctx, optimize_peephole);
+	add_global_pass(ctx, optimize_value_range);
+}
+
+static enum march native_march(void)
+{
+#if defined(__x86_64__) && defined(__GNUC__)
+	__builtin_cpu_init();
+
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+		return MARCH_AVX512;
+
+	if (__builtin_cpu_supports("avx2"))
+		return MARCH_AVX2;
+
+	if (__builtin_cpu_supports("sse4.2"))
+		return MARCH_SSE42;
+#endif
+
+	return MARCH_BASELINE;
+}
+
+static bool parse_march(struct bfc_ctx* ctx, const char* name)
+{
+	if (strcmp(name, "native") == 0) {
+		ctx->march = native_march();
+		return true;
+	}
+
+	for (size_t i = 0; i < array_lenght(march_names); i++) {
+		if (strcmp(name, march_names[i]) == 0) {
+			ctx->march = i;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static bool parse_flag(struct bfc_ctx* ctx, const char* flag)
+{
+	int cell_width;
+	size_t size;
+	char unit = '\0';
+
+	if (sscanf(flag, "cell=%i", &cell_width) == 1) switch (cell_width) {
+	case 8:  ctx->cell_size = CMD_BYTE;  return true;
+	case 16: ctx->cell_size = CMD_WORD;  return true;
+	case 32: ctx->cell_size = CMD_DWORD; return true;
+	case 64: ctx->cell_size = CMD_QWORD; return true;
+	default: return false;
+	}
+
+	if (sscanf(flag, "tape=%zu%c", &size, &unit) >= 1) {
+		switch (unit) {
+		case 'G': size *= 1024; /* fallthrough */
+		case 'M': size *= 1024; /* fallthrough */
+		case 'K': size *= 1024; /* fallthrough */
+		case '\0': break;
+		default: return false;
+		}
+
+		if (size == 0)
+			return false;
+
+		ctx->tape_size = (size + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+		return true;
+	}
+
+	if (strncmp(flag, "cache=", 6) == 0 && flag[6] != '\0') {
+		free(ctx->cache_dir);
+		ctx->cache_dir = strdup(flag + 6);
+
+		return ctx->cache_dir != NULL;
+	}
+
+	if (strcmp(flag, "embed") == 0) {
+		ctx->embed = true;
+		return true;
+	}
+
+	if (strcmp(flag, "huge-pages") == 0) {
+		ctx->use_huge_pages = true;
+		return true;
+	}
+
+	if (strncmp(flag, "march=", 6) == 0)
+		return parse_march(ctx, flag + 6);
+
+	if (strcmp(flag, "vec") == 0) {
+		ctx->use_vec = true;
+		return true;
+	}
+
+	if (strcmp(flag, "no-vec") == 0) {
+		ctx->use_vec = false;
+		return true;
+	}
+
+	return false;
+}
+
+static void add_tape_code(struct bfc_ctx* ctx)
+{
+	if (ctx->embed)
+		return;
+
+	if (ctx->has_prolouge) {
+		size_t start = ctx->cmd_count;
+		generate_tape(ctx);
+
+		size_t count     = ctx->cmd_count - start;
+		struct cmd* tape = reserve_scratch(ctx, count);
+
+		memcpy(tape, ctx->cmds + start, count * sizeof(struct cmd));
+		memmove(ctx->cmds + 1 + count, ctx->cmds + 1, (start - 1) * sizeof(struct cmd));
+		memcpy(ctx->cmds + 1, tape, count * sizeof(struct cmd));
+
+		for (size_t i = 1; i <= count; i++)
+			optimize_zero_mov_to_xor(ctx, &ctx->cmds[i]);
+	}
+
+	if (ctx->has_epiloge) {
+		add_cmd(ctx, &(struct cmd) { .type = CMD_LABEL, .arg0 = NULL, .arg1 = NULL,
+				.label = add_label(ctx, &(struct label) { .type = LABEL, .name = "tape_error" })});
+		compile_syscall(ctx, add_const(ctx, 60), add_const(ctx, 1), NULL, NULL);
+	}
+}
+
+struct ir_table {
+	uint32_t* var_ids;
+	uint32_t* label_ids;
+	struct var** vars;
+	struct label** labels;
+	size_t var_count;
+	size_t label_count;
+	size_t cell_count;
+};
+
+enum ir_ref {
+	IR_REF_NULL = 0,
+	IR_REF_CELL,
+	IR_REF_VAR,
+};
+
+enum ir_operand {
+	IR_ARG0   = 1,
+	IR_ARG1   = 2,
+	IR_LABEL  = 4,
+	IR_TARGET = 8,
+	IR_VEC    = 16,
+};
+
+static const uint8_t ir_operands[] = {
+	[CMD_ADD]     = IR_ARG0 | IR_ARG1,
+	[CMD_SUB]     = IR_ARG0 | IR_ARG1,
+	[CMD_XOR]     = IR_ARG0 | IR_ARG1,
+	[CMD_IMUL]    = IR_ARG0 | IR_ARG1,
+	[CMD_SYSCALL] = 0,
+	[CMD_LABEL]   = IR_LABEL,
+	[CMD_MOV]     = IR_ARG0 | IR_ARG1,
+	[CMD_CMP]     = IR_ARG0 | IR_ARG1,
+	[CMD_JE]      = IR_ARG0 | IR_TARGET,
+	[CMD_JNE]     = IR_ARG0 | IR_TARGET,
+	[CMD_JMP]     = IR_ARG0 | IR_TARGET,
+	[CMD_JA]      = IR_ARG0 | IR_TARGET,
+	[CMD_JB]      = IR_ARG0 | IR_TARGET,
+	[CMD_RET]     = 0,
+	[CMD_LEA]     = IR_ARG0 | IR_ARG1,
+	[CMD_PUSH]    = IR_ARG0,
+	[CMD_POP]     = IR_ARG0,
+	[CMD_MOVDQU]  = IR_ARG0 | IR_ARG1 | IR_VEC,
+	[CMD_PAND]    = IR_ARG0 | IR_ARG1 | IR_VEC,
+	[CMD_PADD]    = IR_ARG0 | IR_ARG1 | IR_VEC,
+	[CMD_EMPTY]   = 0,
+};
+
+static void write_ir_int(FILE* out, uint64_t value)
+{
+	while (value >= 0x80) {
+		fputc((value & 0x7f) | 0x80, out);
+		value >>= 7;
+	}
+
+	fputc(value, out);
+}
+
+static void write_ir_str(FILE* out, const char* str)
+{
+	size_t len = strlen(str);
+
+	write_ir_int(out, len);
+	fwrite(str, 1, len, out);
+}
+
+static void write_ir_var(FILE* out, struct var* var)
+{
+	write_ir_int(out, var->type);
+
+	switch (var->type) {
+	case VAR_STACK:
+		write_ir_int(out, var->value.stack_offset);
+		break;
+
+	case VAR_REGISTER:
+	case VAR_MEM:
+		write_ir_int(out, var->value.reg);
+		break;
+
+	case VAR_CONST:
+		write_ir_int(out, var->value.value);
+		break;
+
+	case VAR_CONST_QWORD:
+		write_ir_int(out, var->value.value64);
+		break;
+
+	case VAR_CONST_STR:
+	case VAR_LABEL:
+		write_ir_str(out, var->value.str);
+		break;
+
+	case VAR_CONST_VEC:
+		fwrite(var->value.str, 1, MAX_VEC_BYTES, out);
+		break;
+
+	default:
+		break;
+	}
+}
+
+static void number_ir_var(struct bfc_ctx* ctx, struct ir_table* table, struct var* var)
+{
+	if (var == NULL)
+		return;
+
+	if (is_cell(ctx, var)) {
+		if (cell_index(ctx, var) >= table->cell_count)
+			table->cell_count = cell_index(ctx, var) + 1;
+
+		return;
+	}
+
+	if (table->var_ids[var->id] == 0) {
+		table->vars[table->var_count++] = var;
+		table->var_ids[var->id]         = table->var_count;
+	}
+}
+
+static void number_ir(struct bfc_ctx* ctx, struct ir_table* table)
+{
+	for (size_t i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		number_ir_var(ctx, table, cmd->arg0);
+		number_ir_var(ctx, table, cmd->arg1);
+
+		if (cmd->label == NULL || table->label_ids[cmd->label->id] != 0)
+			continue;
+
+		table->labels[table->label_count++]  = cmd->label;
+		table->label_ids[cmd->label->id]     = table->label_count;
+		number_ir_var(ctx, table, cmd->label->cell);
+	}
+}
+
+static uint32_t ir_ref(struct bfc_ctx* ctx, struct ir_table* table, struct var* var)
+{
+	if (var == NULL)
+		return IR_REF_NULL;
+
+	if (is_cell(ctx, var))
+		return cell_index(ctx, var) << 2 | IR_REF_CELL;
+
+	return (table->var_ids[var->id] - 1) << 2 | IR_REF_VAR;
+}
+
+static void write_ir(struct bfc_ctx* ctx, FILE* out)
+{
+	struct ir_table table = {
+		.var_ids   = calloc(ctx->var_count + 1, sizeof(uint32_t)),
+		.label_ids = calloc(ctx->label_count + 1, sizeof(uint32_t)),
+		.vars      = malloc((ctx->var_count + 1) * sizeof(struct var*)),
+		.labels    = malloc((ctx->label_count + 1) * sizeof(struct label*)),
+	};
+
+	if (table.var_ids == NULL || table.label_ids == NULL || table.vars == NULL || table.labels == NULL) {
+		free(table.var_ids);
+		free(table.label_ids);
+		free(table.vars);
+		free(table.labels);
+		compile_error(ctx, "out of memory");
+	}
+
+	number_ir(ctx, &table);
+
+	fwrite(IR_MAGIC, 1, sizeof(IR_MAGIC), out);
+	write_ir_int(out, IR_VERSION);
+	write_ir_int(out, ctx->cell_size);
+	write_ir_int(out, ctx->tape_size);
+	write_ir_int(out, ctx->use_huge_pages | ctx->embed << 1);
+
+	write_ir_int(out, table.cell_count);
+	for (size_t i = 0; i < table.cell_count; i++)
+		write_ir_var(out, &ctx->bf_vars[i]);
+
+	write_ir_int(out, table.var_count);
+	for (size_t i = 0; i < table.var_count; i++)
+		write_ir_var(out, table.vars[i]);
+
+	write_ir_int(out, table.label_count);
+	for (size_t i = 0; i < table.label_count; i++) {
+		write_ir_int(out, table.labels[i]->type);
+		write_ir_str(out, table.labels[i]->name);
+		write_ir_int(out, ir_ref(ctx, &table, table.labels[i]->cell));
+	}
+
+	write_ir_int(out, ctx->cmd_count);
+	for (size_t i = 0; i < ctx->cmd_count; i++) {
+		struct cmd* cmd = &ctx->cmds[i];
+
+		write_ir_int(out, cmd->type);
+		write_ir_int(out, cmd->size);
+		write_ir_int(out, ir_ref(ctx, &table, cmd->arg0));
+		write_ir_int(out, ir_ref(ctx, &table, cmd->arg1));
+		write_ir_int(out, cmd->label == NULL ? 0 : table.label_ids[cmd->label->id]);
+	}
+
+	free(table.var_ids);
+	free(table.label_ids);
+	free(table.vars);
+	free(table.labels);
+}
+
+struct ir_reader {
+	struct bfc_ctx* ctx;
+	const unsigned char* data;
+	size_t len;
+	size_t pos;
+};
+
+static bool is_ir(const char* src, size_t len)
+{
+	return len >= sizeof(IR_MAGIC) && memcmp(src, IR_MAGIC, sizeof(IR_MAGIC)) == 0;
+}
+
+static uint64_t read_ir_int(struct ir_reader* reader)
+{
+	uint64_t value = 0;
+
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		if (reader->pos >= reader->len)
+			compile_error(reader->ctx, "IR is truncated");
+
+		uint8_t byte = reader->data[reader->pos++];
+		value |= (uint64_t) (byte & 0x7f) << shift;
+
+		if ((byte & 0x80) == 0)
+			return value;
+	}
+
+	compile_error(reader->ctx, "invalid IR integer");
+	return 0;
+}
+
+static void read_ir_bytes(struct ir_reader* reader, char* buf, size_t size)
+{
+	if (reader->len - reader->pos < size)
+		compile_error(reader->ctx, "IR is truncated");
+
+	memcpy(buf, reader->data + reader->pos, size);
+	reader->pos += size;
+}
+
+static void read_ir_str(struct ir_reader* reader, char* buf, size_t max)
+{
+	size_t len = read_ir_int(reader);
+	if (len >= max)
+		compile_error(reader->ctx, "invalid IR string");
+
+	read_ir_bytes(reader, buf, len);
+	buf[len] = '\0';
+}
+
+static void read_ir_var(struct ir_reader* reader, struct var* var)
+{
+	var->type = read_ir_int(reader);
+
+	switch (var->type) {
+	case VAR_PROG:
+		break;
+
+	case VAR_STACK:
+		var->value.stack_offset = read_ir_int(reader);
+		break;
+
+	case VAR_REGISTER:
+	case VAR_MEM:
+		var->value.reg = read_ir_int(reader);
+		if (var->value.reg > REG_ZMM0)
+			compile_error(reader->ctx, "invalid IR register");
+
+		break;
+
+	case VAR_CONST:
+		var->value.value = read_ir_int(reader);
+		break;
+
+	case VAR_CONST_QWORD:
+		var->value.value64 = read_ir_int(reader);
+		break;
+
+	case VAR_CONST_STR:
+	case VAR_LABEL:
+		read_ir_str(reader, var->value.str, MAX_CONST_STR);
+		break;
+
+	case VAR_CONST_VEC:
+		read_ir_bytes(reader, var->value.str, MAX_VEC_BYTES);
+		break;
+
+	default:
+		compile_error(reader->ctx, "invalid IR variable type");
+	}
+}
+
+static struct var* read_ir_ref(struct ir_reader* reader)
+{
+	struct bfc_ctx* ctx = reader->ctx;
+	uint32_t ref        = read_ir_int(reader);
+	size_t index        = ref >> 2;
+
+	switch (ref & 3) {
+	case IR_REF_NULL:
+		if (ref != 0)
+			break;
+
+		return NULL;
+
+	case IR_REF_CELL:
+		if (index >= ctx->cell_count)
+			break;
+
+		return &ctx->bf_vars[index];
+
+	case IR_REF_VAR:
+		if (index >= ctx->var_count)
+			break;
+
+		return ctx->ir_vars[index];
+	}
+
+	compile_error(ctx, "invalid IR reference");
+	return NULL;
+}
+
+static size_t read_ir_count(struct ir_reader* reader, size_t min_size)
+{
+	size_t count = read_ir_int(reader);
+	if (count > (reader->len - reader->pos) / min_size)
+		compile_error(reader->ctx, "IR is truncated");
+
+	return count;
+}
+
+static bool is_vec_cmd_reg(struct cmd* cmd)
+{
+	struct var* reg = cmd->arg1->type == VAR_REGISTER ? cmd->arg1 : cmd->arg0;
+
+	return reg->type == VAR_REGISTER && reg->value.reg >= REG_XMM0;
+}
+
+static void load_ir(struct bfc_ctx* ctx, const char* src, size_t len)
+{
+	struct ir_reader reader = { .ctx = ctx, .data = (const unsigned char*) src, .len = len,
+		.pos = sizeof(IR_MAGIC) };
+
+	if (read_ir_int(&reader) != IR_VERSION)
+		compile_error(ctx, "unsupported IR version");
+
+	ctx->cell_size = read_ir_int(&reader);
+	ctx->tape_size = read_ir_int(&reader);
+
+	uint8_t flags       = read_ir_int(&reader);
+	ctx->use_huge_pages = flags & 1;
+	ctx->embed          = (flags & 2) != 0;
+
+	if (ctx->cell_size > CMD_QWORD || ctx->tape_size < PAGE_SIZE)
+		compile_error(ctx, "invalid IR options");
+
+	size_t cell_count = read_ir_count(&reader, 1);
+	if (cell_count > ctx->tape_size / cell_bytes(ctx))
+		compile_error(ctx, "invalid IR cell count");
+
+	alloc_cells(ctx, cell_count);
+
+	for (size_t i = 0; i < cell_count; i++)
+		read_ir_var(&reader, &ctx->bf_vars[i]);
+
+	size_t var_count = read_ir_count(&reader, 1);
+	ctx->ir_vars     = malloc((var_count + 1) * sizeof(struct var*));
+	if (ctx->ir_vars == NULL)
+		compile_error(ctx, "out of memory");
+
+	for (size_t i = 0; i < var_count; i++) {
+		struct var var = {0};
+
+		read_ir_var(&reader, &var);
+		ctx->ir_vars[i] = add_var(ctx, &var);
+	}
+
+	size_t label_count = read_ir_count(&reader, 3);
+	ctx->ir_labels     = malloc((label_count + 1) * sizeof(struct label*));
+	if (ctx->ir_labels == NULL)
+		compile_error(ctx, "out of memory");
+
+	for (size_t i = 0; i < label_count; i++) {
+		struct label label = {0};
+
+		label.type = read_ir_int(&reader);
+		if (label.type > LABEL_GLOBL)
+			compile_error(ctx, "invalid IR label type");
+
+		read_ir_str(&reader, label.name, MAX_LABEL_NAME);
+		label.cell = read_ir_ref(&reader);
+		if (label.cell != NULL && !is_cell(ctx, label.cell))
+			compile_error(ctx, "invalid IR label cell");
+
+		ctx->ir_labels[i] = add_label(ctx, &label);
+	}
+
+	size_t cmd_count = read_ir_count(&reader, 5);
+	if (cmd_count == 0)
+		compile_error(ctx, "IR has no commands");
+
+	reserve_cmds(ctx, cmd_count);
+
+	for (size_t i = 0; i < cmd_count; i++) {
+		struct cmd cmd = {0};
+
+		cmd.type = read_ir_int(&reader);
+		cmd.size = read_ir_int(&reader);
+		if (cmd.type > CMD_EMPTY || cmd.size > CMD_QWORD)
+			compile_error(ctx, "invalid IR command");
+
+		cmd.arg0 = read_ir_ref(&reader);
+		cmd.arg1 = read_ir_ref(&reader);
+
+		uint32_t label = read_ir_int(&reader);
+		if (label > label_count)
+			compile_error(ctx, "invalid IR label reference");
+
+		cmd.label = label == 0 ? NULL : ctx->ir_labels[label - 1];
+
+		uint8_t operands = ir_operands[cmd.type];
+		if (((operands & IR_ARG0) && cmd.arg0 == NULL) || ((operands & IR_ARG1) && cmd.arg1 == NULL) ||
+				((operands & IR_LABEL) && cmd.label == NULL) ||
+				((operands & IR_TARGET) && cmd.arg0->type != VAR_LABEL) ||
+				((operands & IR_VEC) && !is_vec_cmd_reg(&cmd)))
+			compile_error(ctx, "invalid IR operands");
+
+		add_cmd(ctx, &cmd);
+	}
+
+	if (reader.pos != reader.len)
+		compile_error(ctx, "trailing data after IR");
+}
+
+static void compile_source(struct bfc_ctx* ctx, const char* src, size_t len)
+{
+	double start = now();
+
+	compile(ctx, src, len);
+	start = end_phase(ctx, PHASE_PARSE, start);
+
+	dispence_registers(ctx);
+	start = end_phase(ctx, PHASE_ALLOCATE, start);
+
+	add_passes(ctx);
+	apply_passes(ctx);
+	end_phase(ctx, PHASE_OPTIMIZE, start);
+}
+
+static void lower_output(struct bfc_ctx* ctx)
+{
+	if (ctx->backend != BACKEND_ASM)
+		return;
+
+	add_tape_code(ctx);
+
+	if (ctx->use_vec && ctx->march != MARCH_FAT)
+		lower_vec(ctx);
+}
+
+static void print_dispatcher(struct bfc_ctx* ctx, const char* entry, FILE* file)
+{
+	fprintf(file, ".text\n.globl %s\n", entry);
+	if (ctx->embed)
+		fprintf(file, ".type %s, @function\n", entry);
+
+	fprintf(file,
+		"%1$s:\n"
+		"\tpush %%rbx\n"
+		"\tpush %%rcx\n"
+		"\tpush %%rdx\n"
+		"\tlea %1$s_baseline(%%rip), %%r11\n"
+		"\txor %%eax, %%eax\n"
+		"\tcpuid\n"
+		"\tcmp $7, %%eax\n"
+		"\tjb .Lbf_dispatch\n"
+		"\tmov $1, %%eax\n"
+		"\tcpuid\n"
+		"\tand $0x18000000, %%ecx\n"
+		"\tcmp $0x18000000, %%ecx\n"
+		"\tjne .Lbf_dispatch\n"
+		"\txor %%ecx, %%ecx\n"
+		"\txgetbv\n"
+		"\tmov %%eax, %%r10d\n"
+		"\tand $6, %%eax\n"
+		"\tcmp $6, %%eax\n"
+		"\tjne .Lbf_dispatch\n"
+		"\tmov $7, %%eax\n"
+		"\txor %%ecx, %%ecx\n"
+		"\tcpuid\n"
+		"\ttest $0x20, %%ebx\n"
+		"\tjz .Lbf_dispatch\n"
+		"\tlea %1$s_avx2(%%rip), %%r11\n"
+		"\tand $0xe6, %%r10d\n"
+		"\tcmp $0xe6, %%r10d\n"
+		"\tjne .Lbf_dispatch\n"
+		"\tand $0x40010000, %%ebx\n"
+		"\tcmp $0x40010000, %%ebx\n"
+		"\tjne .Lbf_dispatch\n"
+		"\tlea %1$s_avx512(%%rip), %%r11\n"
+		".Lbf_dispatch:\n"
+		"\tpop %%rdx\n"
+		"\tpop %%rcx\n"
+		"\tpop %%rbx\n"
+		"\tjmp *%%r11\n", entry);
+}
+
+static void create_fat_asm(struct bfc_ctx* ctx, FILE* file)
+{
+	const char* entry = NULL;
+	struct cmd* cmds  = reserve_scratch(ctx, ctx->cmd_count);
+
+	memcpy(cmds, ctx->cmds, ctx->cmd_count * sizeof(struct cmd));
+
+	for (size_t i = 0; i < ctx->cmd_count && entry == NULL; i++) {
+		if (cmds[i].type == CMD_LABEL && cmds[i].label->type == LABEL_GLOBL)
+			entry = cmds[i].label->name;
+	}
+
+	for (size_t i = 0; i < array_lenght(fat_variants); i++) {
+		memcpy(ctx->cmds, cmds, ctx->cmd_count * sizeof(struct cmd));
+
+		ctx->march         = fat_variants[i];
+		ctx->const_str_num = 0;
+		sprintf(ctx->variant_suffix, "_%s", march_names[ctx->march]);
+
+		if (ctx->use_vec)
+			lower_vec(ctx);
+
+		create_asm(ctx, file);
+	}
+
+	ctx->march             = MARCH_FAT;
+	ctx->variant_suffix[0] = '\0';
+
+	if (entry != NULL)
+		print_dispatcher(ctx, entry, file);
+}
+
+static void create_output(struct bfc_ctx* ctx, FILE* out)
+{
+	double start = now();
+
+	lower_output(ctx);
+	start = end_phase(ctx, PHASE_LOWER, start);
+
+	switch (ctx->backend) {
+	case BACKEND_ASM:
+		if (ctx->march == MARCH_FAT)
+			create_fat_asm(ctx, out);
+		else
+			create_asm(ctx, out);
+
+		break;
+
+	case BACKEND_C:
+		create_c(ctx, out);
+		break;
+
+	case BACKEND_LLVM:
+		create_llvm(ctx, out);
+		break;
+
+	case BACKEND_IR:
+		write_ir(ctx, out);
+		break;
+	}
+
+	end_phase(ctx, PHASE_EMIT, start);
+}
+
+static bool add_region(struct bfc_ctx* ctx, size_t start, size_t end, size_t entry_cell)
+{
+	if (ctx->region_count % 64 == 0) {
+		struct region* regions = realloc(ctx->regions, (ctx->region_count + 64) * sizeof(struct region));
+		if (regions == NULL)
+			return false;
+
+		ctx->regions = regions;
+	}
+
+	ctx->regions[ctx->region_count++] = (struct region) { .start = start, .len = end - start,
+		.entry_cell = entry_cell };
+
+	return true;
+}
+
+static uint64_t hash_bytes(uint64_t hash, const void* data, size_t len)
+{
+	const unsigned char* bytes = data;
+
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ bytes[i]) * HASH_PRIME;
+
+	return hash;
+}
+
+static bool is_region_end(const char* src, size_t start, size_t loop_start, size_t end)
+{
+	if (end - start >= MIN_REGION_SIZE)
+		return true;
+
+	return end - start >= MIN_CUT_REGION_SIZE &&
+		(hash_bytes(HASH_SEED, src + loop_start, end - loop_start) & REGION_CUT_MASK) == 0;
+}
+
+static bool split_source(struct bfc_ctx* ctx, const char* src, size_t len)
+{
+	size_t level = 0, cell = 0;
+	size_t start = 0, entry_cell = 0, loop_start = 0;
+
+	for (size_t i = 0; i < len; i++) {
+		switch (src[i]) {
+		case '>':
+			cell++;
+			break;
 
-	in_path  = argv[1];
-	out_path = argv[2];
+		case '<':
+			if (cell-- == 0)
+				return false;
 
-	FILE* in = fopen(in_path, "r");
-	if (in == NULL)
+			break;
+
+		case '[':
+			if (level++ == 0)
+				loop_start = i;
+
+			break;
+
+		case ']':
+			if (level-- == 0)
+				return false;
+
+			break;
+		}
+
+		if (src[i] != ']' || level != 0 || i + 1 == len || !is_region_end(src, start, loop_start, i + 1))
+			continue;
+
+		if (!add_region(ctx, start, i + 1, entry_cell))
+			return false;
+
+		start      = i + 1;
+		entry_cell = cell;
+	}
+
+	return level == 0 && ctx->region_count != 0 && add_region(ctx, start, len, entry_cell);
+}
+
+static char* read_file(FILE* file, size_t* size)
+{
+	size_t capacity = 4096;
+	char* buf = malloc(capacity);
+
+	*size = 0;
+
+	for (size_t n; buf != NULL && (n = fread(buf + *size, 1, capacity - *size, file)) > 0;) {
+		*size += n;
+
+		if (*size == capacity) {
+			char* new_buf = realloc(buf, capacity *= 2);
+			if (new_buf == NULL)
+				free(buf);
+
+			buf = new_buf;
+		}
+	}
+
+	return buf;
+}
+
+static bool write_full(int fd, const void* buf, size_t size)
+{
+	for (size_t done = 0; done < size;) {
+		ssize_t n = write(fd, (const char*) buf + done, size - done);
+		if (n <= 0)
+			return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+struct region_key {
+	uint64_t key;
+	size_t index;
+};
+
+static int compare_region_keys(const void* a, const void* b)
+{
+	const struct region_key* lhs = a;
+	const struct region_key* rhs = b;
+
+	if (lhs->key != rhs->key)
+		return lhs->key < rhs->key ? -1 : 1;
+
+	return lhs->index < rhs->index ? -1 : lhs->index > rhs->index;
+}
+
+static void set_region_keys(struct bfc_ctx* ctx, const char* src)
+{
+	struct region_key* keys = malloc(ctx->region_count * sizeof(struct region_key));
+	uint64_t seed = hash_bytes(HASH_SEED, BFC_BUILD_ID, strlen(BFC_BUILD_ID));
+
+	if (keys == NULL)
+		compile_error(ctx, "out of memory");
+
+	for (size_t i = 0; i < ctx->region_count; i++) {
+		struct region* region = &ctx->regions[i];
+		uint64_t header[] = { CACHE_VERSION, ctx->backend, ctx->cell_size, ctx->tape_size,
+			ctx->use_huge_pages, ctx->embed, ctx->use_vec, ctx->march, region->entry_cell, i == 0,
+			i == ctx->region_count - 1 };
+
+		keys[i].key   = hash_bytes(hash_bytes(seed, header, sizeof(header)), src + region->start,
+				region->len);
+		keys[i].index = i;
+	}
+
+	qsort(keys, ctx->region_count, sizeof(struct region_key), compare_region_keys);
+
+	for (size_t i = 0, occurrence = 0; i < ctx->region_count; i++) {
+		occurrence = i > 0 && keys[i].key == keys[i - 1].key ? occurrence + 1 : 0;
+		ctx->regions[keys[i].index].key = hash_bytes(keys[i].key, &occurrence, sizeof(occurrence));
+	}
+
+	free(keys);
+}
+
+static bool load_region(const char* dir, struct region* region)
+{
+	char path[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%016" PRIx64 ".s", dir, region->key);
+
+	FILE* file = fopen(path, "r");
+	if (file == NULL)
+		return false;
+
+	region->out_buf = read_file(file, &region->out_size);
+	fclose(file);
+
+	return region->out_buf != NULL;
+}
+
+static void store_region(const char* dir, struct region* region)
+{
+	char path[PATH_MAX], temp[PATH_MAX];
+
+	snprintf(path, sizeof(path), "%s/%016" PRIx64 ".s", dir, region->key);
+	snprintf(temp, sizeof(temp), "%s/.%016" PRIx64 ".XXXXXX", dir, region->key);
+
+	int fd = mkstemp(temp);
+	if (fd < 0)
+		return;
+
+	bool is_written = write_full(fd, region->out_buf, region->out_size);
+	close(fd);
+
+	if (!is_written || rename(temp, path) != 0)
+		unlink(temp);
+}
+
+struct split_job {
+	struct bfc_ctx* ctx;
+	const char* src;
+
+	pthread_mutex_t lock;
+	size_t next_region;
+};
+
+static void print_times(struct bfc_ctx* ctx, double total, FILE* file)
+{
+	for (size_t i = 0; i < PHASE_COUNT; i++)
+		fprintf(file, "bfc1: time %s: %.3fs\n", phase_names[i], ctx->phase_times[i]);
+
+	fprintf(file, "bfc1: time total: %.3fs\n", total);
+
+	for (size_t i = 0; i < PHASE_COUNT; i++)
+		fprintf(file, "bfc1: memory %s: %ldK\n", phase_names[i], ctx->phase_memory[i]);
+
+	fprintf(file, "bfc1: memory peak: %ldK\n", peak_memory());
+}
+
+static void add_stats(struct bfc_ctx* ctx, struct bfc_ctx* region)
+{
+	for (size_t i = 0; i < MAX_PEEPHOLE_RULES; i++)
+		ctx->peephole_hits[i] += region->peephole_hits[i];
+
+	ctx->removed_loops            += region->removed_loops;
+	ctx->rotated_loops            += region->rotated_loops;
+	ctx->removed_stores           += region->removed_stores;
+	ctx->counted_loops            += region->counted_loops;
+	ctx->unrolled_loops           += region->unrolled_loops;
+	ctx->partially_unrolled_loops += region->partially_unrolled_loops;
+
+	for (size_t i = 0; i < PHASE_COUNT; i++) {
+		ctx->phase_times[i]  += region->phase_times[i];
+		ctx->phase_memory[i] += region->phase_memory[i];
+	}
+}
+
+static void compile_region(struct split_job* job, size_t index)
+{
+	struct region* region = &job->ctx->regions[index];
+	const char* cache_dir = job->ctx->cache_dir;
+
+	if (cache_dir != NULL && load_region(cache_dir, region)) {
+		region->status = 0;
+
+		pthread_mutex_lock(&job->lock);
+		job->ctx->cache_hits++;
+		pthread_mutex_unlock(&job->lock);
+
+		return;
+	}
+
+	FILE* out = open_memstream(&region->out_buf, &region->out_size);
+	FILE* err = open_memstream(&region->err_buf, &region->err_size);
+	struct bfc_ctx* ctx = out != NULL && err != NULL ? bfc_create(err) : NULL;
+
+	region->status = 1;
+
+	if (ctx != NULL) {
+		ctx->backend        = job->ctx->backend;
+		ctx->cell_size      = job->ctx->cell_size;
+		ctx->tape_size      = job->ctx->tape_size;
+		ctx->use_huge_pages = job->ctx->use_huge_pages;
+		ctx->embed          = job->ctx->embed;
+		ctx->use_vec        = job->ctx->use_vec;
+		ctx->march          = job->ctx->march;
+
+		ctx->is_region    = true;
+		ctx->has_prolouge = index == 0;
+		ctx->has_epiloge  = index == job->ctx->region_count - 1;
+		ctx->crnt_var     = region->entry_cell;
+		sprintf(ctx->label_suffix, "_%016" PRIx64, region->key);
+
+		region->status = bfc_compile(ctx, job->src + region->start, region->len, out);
+
+		pthread_mutex_lock(&job->lock);
+		add_stats(job->ctx, ctx);
+		job->ctx->cache_misses += cache_dir != NULL;
+		pthread_mutex_unlock(&job->lock);
+	}
+
+	bfc_destroy(ctx);
+
+	if (out != NULL) fclose(out);
+	if (err != NULL) fclose(err);
+
+	if (cache_dir != NULL && region->status == 0)
+		store_region(cache_dir, region);
+}
+
+static void* compile_regions_worker(void* arg)
+{
+	struct split_job* job = arg;
+
+	for (;;) {
+		pthread_mutex_lock(&job->lock);
+		size_t index = job->next_region++;
+		pthread_mutex_unlock(&job->lock);
+
+		if (index >= job->ctx->region_count)
+			return NULL;
+
+		compile_region(job, index);
+	}
+}
+
+static int compile_regions(struct bfc_ctx* ctx, const char* src, FILE* out)
+{
+	struct split_job job = { .ctx = ctx, .src = src, .next_region = 0 };
+	pthread_t threads[MAX_JOBS];
+	size_t thread_count = 0;
+	int status = 0;
+
+	set_region_keys(ctx, src);
+
+	if (ctx->cache_dir != NULL)
+		mkdir(ctx->cache_dir, 0777);
+
+	pthread_mutex_init(&job.lock, NULL);
+
+	while (thread_count + 1 < ctx->jobs && thread_count + 1 < ctx->region_count &&
+			pthread_create(&threads[thread_count], NULL, compile_regions_worker, &job) == 0)
+		thread_count++;
+
+	compile_regions_worker(&job);
+
+	for (size_t i = 0; i < thread_count; i++)
+		pthread_join(threads[i], NULL);
+
+	pthread_mutex_destroy(&job.lock);
+
+	for (size_t i = 0; i < ctx->region_count; i++) {
+		struct region* region = &ctx->regions[i];
+
+		fwrite(region->err_buf, 1, region->err_size, ctx->err);
+		if (status == 0 && region->status == 0)
+			fwrite(region->out_buf, 1, region->out_size, out);
+
+		status = region->status != 0 ? region->status : status;
+
+		free(region->out_buf);
+		free(region->err_buf);
+	}
+
+	return status;
+}
+
+struct bfc_ctx* bfc_create(FILE* err)
+{
+	struct bfc_ctx* ctx = calloc(1, sizeof(struct bfc_ctx));
+	if (ctx == NULL)
+		return NULL;
+
+	ctx->err          = err;
+	ctx->tape_size    = DEFAULT_TAPE_SIZE;
+	ctx->use_vec      = true;
+	ctx->jobs         = 1;
+	ctx->has_prolouge = true;
+	ctx->has_epiloge  = true;
+
+	return ctx;
+}
+
+void bfc_destroy(struct bfc_ctx* ctx)
+{
+	if (ctx == NULL)
+		return;
+
+	while (ctx->var_blocks != NULL) {
+		struct var_block* next = ctx->var_blocks->next;
+		free(ctx->var_blocks);
+		ctx->var_blocks = next;
+	}
+
+	while (ctx->label_blocks != NULL) {
+		struct label_block* next = ctx->label_blocks->next;
+		free(ctx->label_blocks);
+		ctx->label_blocks = next;
+	}
+
+	free(ctx->cmds);
+	free(ctx->bf_vars);
+	free(ctx->cell_states);
+	free(ctx->is_read);
+	free(ctx->scratch_cmds);
+	free(ctx->consts);
+	free(ctx->regions);
+	free(ctx->cache_dir);
+	free(ctx->ir_vars);
+	free(ctx->ir_labels);
+	free(ctx->data_nums);
+	free(ctx->deferred);
+	free(ctx->deferred_cmds);
+	free(ctx);
+}
+
+bool bfc_set_option(struct bfc_ctx* ctx, char option, const char* value)
+{
+	switch (option) {
+	case 'e':
+		if (strcmp(value, "asm") == 0) {
+			ctx->backend = BACKEND_ASM;
+		} else if (strcmp(value, "c") == 0) {
+			ctx->backend = BACKEND_C;
+		} else if (strcmp(value, "llvm") == 0) {
+			ctx->backend = BACKEND_LLVM;
+		} else if (strcmp(value, "ir") == 0) {
+			ctx->backend = BACKEND_IR;
+		} else {
+			fprintf(ctx->err, "bfc1: unknown backend %s\n", value);
+			return false;
+		}
+
+		return true;
+
+	case 'f':
+		if (!parse_flag(ctx, value)) {
+			fprintf(ctx->err, "bfc1: invalid flag -f%s\n", value);
+			return false;
+		}
+
+		return true;
+
+	case 's':
+		ctx->show_stats = true;
+		return true;
+
+	case 't':
+		ctx->show_times = true;
+		return true;
+
+	case 'j':
+		if (sscanf(value, "%zu", &ctx->jobs) != 1 || ctx->jobs == 0 || ctx->jobs > MAX_JOBS) {
+			fprintf(ctx->err, "bfc1: invalid jobs count %s\n", value);
+			return false;
+		}
+
+		return true;
+
+	default:
+		fprintf(ctx->err, "bfc1: unknown option -%c\n", option);
+		return false;
+	}
+}
+
+int bfc_compile(struct bfc_ctx* ctx, const char* src, size_t len, FILE* out)
+{
+	if (setjmp(ctx->error) != 0)
+		return 1;
+
+	if (ctx->cmd_count != 0 || ctx->region_count != 0)
+		compile_error(ctx, "context is already used");
+
+	double start     = now();
+	ctx->memory_mark = peak_memory();
+
+	bool from_ir = !ctx->is_region && is_ir(src, len);
+	if (from_ir) {
+		load_ir(ctx, src, len);
+		end_phase(ctx, PHASE_PARSE, start);
+	}
+
+	if (ctx->embed && ctx->backend != BACKEND_ASM && ctx->backend != BACKEND_IR)
+		compile_error(ctx, "-fembed is only supported by asm backend");
+
+	int status = 0;
+
+	if (from_ir) {
+		create_output(ctx, out);
+	} else if ((ctx->jobs > 1 || ctx->cache_dir != NULL) && ctx->backend == BACKEND_ASM &&
+			ctx->march != MARCH_FAT && split_source(ctx, src, len)) {
+		status = compile_regions(ctx, src, out);
+	} else {
+		compile_source(ctx, src, len);
+		create_output(ctx, out);
+	}
+
+	if (ctx->show_stats)
+		print_stats(ctx, ctx->err);
+
+	if (ctx->show_times)
+		print_times(ctx, now() - start, ctx->err);
+
+	return status;
+}
+
+#ifndef BFC_LIBRARY
+
+static bool read_full(int fd, void* buf, size_t size, double deadline)
+{
+	for (size_t done = 0; done < size;) {
+		ssize_t n = read(fd, (char*) buf + done, size - done);
+		if (n <= 0 || now() > deadline)
+			return false;
+
+		done += n;
+	}
+
+	return true;
+}
+
+static bool write_block(int fd, const char* buf, uint64_t size)
+{
+	return write_full(fd, &size, sizeof(size)) && write_full(fd, buf, size);
+}
+
+static char* read_request(int fd, char* args, int* argc, char** argv, size_t* src_size)
+{
+	double deadline = now() + REQUEST_TIMEOUT;
+	uint32_t args_size;
+	uint64_t size;
+
+	if (!read_full(fd, &args_size, sizeof(args_size), deadline) ||
+			args_size > MAX_REQUEST_ARGS_SIZE || !read_full(fd, args, args_size, deadline) ||
+			!read_full(fd, &size, sizeof(size), deadline) || size > MAX_REQUEST_SIZE)
+		return NULL;
+
+	if (args_size != 0 && args[args_size - 1] != '\0')
+		return NULL;
+
+	*argc = 0;
+	for (size_t i = 0; i < args_size && *argc < MAX_REQUEST_ARGS; i += strlen(args + i) + 1)
+		argv[(*argc)++] = args + i;
+
+	char* src = malloc(size);
+	if (src == NULL || !read_full(fd, src, size, deadline)) {
+		free(src);
+		return NULL;
+	}
+
+	*src_size = size;
+
+	return src;
+}
+
+static bool set_request_options(struct bfc_ctx* ctx, int argc, char** argv)
+{
+	for (int i = 0; i < argc; i++) {
+		char option       = argv[i][1];
+		const char* value = argv[i] + 2;
+
+		if (argv[i][0] != '-' || option == '\0') {
+			fprintf(ctx->err, "bfc1: invalid argument %s\n", argv[i]);
+			return false;
+		}
+
+		if (*value == '\0' && option != 's' && option != 't' && i + 1 < argc)
+			value = argv[++i];
+
+		if (!bfc_set_option(ctx, option, value))
+			return false;
+	}
+
+	if (ctx->cache_dir != NULL) {
+		fprintf(ctx->err, "bfc1: -fcache is not supported by server\n");
+		return false;
+	}
+
+	return true;
+}
+
+static void serve_request(int fd)
+{
+	char args[MAX_REQUEST_ARGS_SIZE];
+	char* argv[MAX_REQUEST_ARGS];
+	int argc;
+
+	char* out_buf = NULL;
+	char* err_buf = NULL;
+	size_t out_size = 0, err_size = 0, src_size;
+	uint32_t status = 1;
+
+	FILE* out = open_memstream(&out_buf, &out_size);
+	FILE* err = open_memstream(&err_buf, &err_size);
+	char* src = read_request(fd, args, &argc, argv, &src_size);
+
+	if (out != NULL && err != NULL && src != NULL) {
+		struct bfc_ctx* ctx = bfc_create(err);
+
+		if (ctx != NULL && set_request_options(ctx, argc, argv))
+			status = bfc_compile(ctx, src, src_size, out);
+
+		bfc_destroy(ctx);
+	}
+
+	if (out != NULL) fclose(out);
+	if (err != NULL) fclose(err);
+
+	if (write_full(fd, &status, sizeof(status)) && write_block(fd, err_buf, err_size))
+		write_block(fd, out_buf, status == 0 ? out_size : 0);
+
+	free(src);
+	free(out_buf);
+	free(err_buf);
+	close(fd);
+}
+
+static void* serve_worker(void* arg)
+{
+	int sock = *(int*) arg;
+	struct timeval timeout = { .tv_sec = REQUEST_TIMEOUT };
+
+	for (;;) {
+		int fd = accept(sock, NULL, NULL);
+		if (fd < 0)
+			continue;
+
+		setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+		serve_request(fd);
+	}
+
+	return NULL;
+}
+
+static int serve(const char* path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if (strlen(path) >= sizeof(addr.sun_path)) {
+		fprintf(stderr, "bfc1: socket path is too long\n");
+		return 1;
+	}
+
+	strcpy(addr.sun_path, path);
+
+	int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (sock < 0)
+		return 1;
+
+	unlink(path);
+
+	mode_t mask = umask(0177);
+	bool bound  = bind(sock, (struct sockaddr*) &addr, sizeof(addr)) == 0;
+	umask(mask);
+
+	if (!bound || listen(sock, SOMAXCONN) < 0) {
+		fprintf(stderr, "bfc1: can't listen on %s\n", path);
+		return 1;
+	}
+
+	signal(SIGPIPE, SIG_IGN);
+
+	long worker_count = sysconf(_SC_NPROCESSORS_ONLN);
+	if (worker_count < 1)
+		worker_count = 1;
+
+	for (long i = 1; i < worker_count; i++) {
+		pthread_t thread;
+
+		if (pthread_create(&thread, NULL, serve_worker, &sock) == 0)
+			pthread_detach(thread);
+	}
+
+	serve_worker(&sock);
+
+	return 0;
+}
+
+int main(int argc, char* argv[])
+{
+	if (argc == 3 && strcmp(argv[1], "--serve") == 0)
+		return serve(argv[2]);
+
+	if (argc < 3)
+		return 1;
+
+	struct bfc_ctx* ctx = bfc_create(stderr);
+	if (ctx == NULL)
 		return 1;
 
-	fseek(in, 0L, SEEK_END);
-	size_t size = ftell(in);
-	fseek(in, 0L, SEEK_SET);
+	optind = 3;
+
+	int c;
+	while ((c = getopt(argc, argv, "e:f:stj:")) != -1) {
+		if (c == '?' || !bfc_set_option(ctx, c, optarg))
+			return 1;
+	}
+
+	FILE* in = fopen(argv[1], "r");
+	if (in == NULL)
+		return 1;
 
-	char prog_buf[MAX_PROG_SIZE];
-	fread(prog_buf, MAX_PROG_SIZE, size, in); 
+	size_t prog_size;
+	char* prog_buf = read_file(in, &prog_size);
 
 	fclose(in);
 
-	compile(prog_buf);
-	dispence_registers();
-	add_passes();
-	apply_passes();
+	if (prog_buf == NULL)
+		return 1;
 
-	FILE* out = fopen(out_path, "w");
+	FILE* out = fopen(argv[2], "w");
 	if (out == NULL)
 		return 1;
 
-	create_asm(out);
+	int status = bfc_compile(ctx, prog_buf, prog_size, out);
 
 	fclose(out);
+	free(prog_buf);
+	bfc_destroy(ctx);
 
-	return 0;
+	if (status != 0)
+		remove(argv[2]);
+
+	return status;
 }
+
+#endif
@@ -0,0 +1,200 @@
+/*
+	Permission to use, copy, modify, and/or distribute this software for
+	any purpose with or without fee is hereby granted.
+
+	THE SOFTWARE IS PROVIDED “AS IS” AND THE AUTHOR DISCLAIMS ALL
+	WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES
+	OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE
+	FOR ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY
+	DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN
+	AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT
+	OF OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <unistd.h>
+
+#define SMALL_USAGE "usage: [-s size][-d depth][-l loops][-i io][-c cells][-r seed][-h]\n"
+#define USAGE \
+	"    [-s size]      program size in bytes, may be followed by K, M or G, default is 1K\n" \
+	"    [-d depth]     maximal loop nesting depth, default is 4\n" \
+	"    [-l loops]     percent of steps opening or closing loop, default is 5\n" \
+	"    [-i io]        percent of steps doing input or output, default is 2\n" \
+	"    [-c cells]     number of cells used by program, default is 64\n" \
+	"    [-r seed]      random seed, default is 1\n" \
+	"    [-h]           print this menu\n"
+
+#define MAX_DEPTH 128
+#define MAX_RUN 8
+#define MAX_MOVE 4
+
+static void usage(bool small, FILE* stream)
+{
+	fprintf(stream, "%s", small ? SMALL_USAGE : SMALL_USAGE USAGE);
+}
+
+static uint64_t state;
+
+static uint64_t next_random(void)
+{
+	state ^= state << 13;
+	state ^= state >> 7;
+	state ^= state << 17;
+
+	return state;
+}
+
+static size_t random_below(size_t n)
+{
+	return next_random() % n;
+}
+
+static bool parse_size(const char* str, size_t* size)
+{
+	char unit = '\0';
+
+	if (sscanf(str, "%zu%c", size, &unit) < 1)
+		return false;
+
+	switch (unit) {
+	case 'G': *size *= 1024; /* fallthrough */
+	case 'M': *size *= 1024; /* fallthrough */
+	case 'K': *size *= 1024; /* fallthrough */
+	case '\0': return true;
+	default: return false;
+	}
+}
+
+static size_t loop_cells[MAX_DEPTH];
+static size_t depth;
+static size_t pos;
+static size_t len;
+
+static void emit(char c, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+		putchar(c);
+
+	len += count;
+}
+
+static void move_to(size_t cell)
+{
+	if (cell > pos)
+		emit('>', cell - pos);
+	else
+		emit('<', pos - cell);
+
+	pos = cell;
+}
+
+static bool is_loop_cell(size_t cell)
+{
+	for (size_t i = 0; i < depth; i++) {
+		if (loop_cells[i] == cell)
+			return true;
+	}
+
+	return false;
+}
+
+static void close_loop(void)
+{
+	move_to(loop_cells[--depth]);
+	emit(']', 1);
+}
+
+int main(int argc, char* argv[])
+{
+	size_t size        = 1024;
+	size_t max_depth   = 4;
+	size_t loops       = 5;
+	size_t io          = 2;
+	size_t cells       = 64;
+
+	state = 1;
+
+	int c;
+	while ((c = getopt(argc, argv, "s:d:l:i:c:r:h")) != -1) switch (c) {
+	case 's':
+		if (!parse_size(optarg, &size)) {
+			usage(true, stderr);
+			exit(1);
+		}
+
+		break;
+
+	case 'd':
+		max_depth = atoi(optarg);
+		break;
+
+	case 'l':
+		loops = atoi(optarg);
+		break;
+
+	case 'i':
+		io = atoi(optarg);
+		break;
+
+	case 'c':
+		cells = atoi(optarg);
+		break;
+
+	case 'r':
+		state = strtoull(optarg, NULL, 0);
+		break;
+
+	case 'h':
+		usage(false, stdout);
+		exit(0);
+
+	case '?':
+		usage(true, stderr);
+		exit(1);
+	}
+
+	if (max_depth > MAX_DEPTH || cells < max_depth + 2 || loops + io > 100 || state == 0) {
+		usage(true, stderr);
+		exit(1);
+	}
+
+	while (len < size) {
+		size_t step = random_below(100);
+
+		if (step < loops) {
+			if (depth > 0 && (depth == max_depth || step % 2 == 1)) {
+				close_loop();
+			} else if (!is_loop_cell(pos)) {
+				loop_cells[depth++] = pos;
+				emit('[', 1);
+				emit('-', 1);
+			}
+
+			continue;
+		}
+
+		if (step < loops + io) {
+			emit(step % 2 == 0 || is_loop_cell(pos) ? '.' : ',', 1);
+			continue;
+		}
+
+		if (step % 2 == 0 && !is_loop_cell(pos)) {
+			emit(step % 4 == 0 ? '+' : '-', 1 + random_below(MAX_RUN));
+			continue;
+		}
+
+		size_t distance = 1 + random_below(MAX_MOVE);
+		if (random_below(2) == 0)
+			move_to(pos + distance < cells ? pos + distance : cells - 1);
+		else
+			move_to(pos >= distance ? pos - distance : 0);
+	}
+
+	while (depth > 0)
+		close_loop();
+
+	return 0;
+}
@@ -0,0 +1,79 @@
+#!/bin/sh
+# usage: check.sh [test...]
+#
+# Compiles every program in tests with bfc to asm, c and llvm output and
+# compares what it prints for tests/NAME.in with tests/NAME.out.  Code
+# generation flags are read from tests/NAME.flags.  llvm output is checked
+# only if CLANG is found.  Then loads IR of tests/hello.bf cut at every
+# length and with every byte zeroed, which must fail with an error or
+# compile, but never crash bfc1.
+
+BFC=${BFC:-./bfc}
+BFC1=${BFC1:-./bfc1}
+CLANG=${CLANG:-clang}
+
+[ $# -eq 0 ] && set -- $(ls tests/*.bf | sed 's|tests/\(.*\)\.bf|\1|')
+
+emits="asm c"
+if command -v "$CLANG" > /dev/null; then
+	emits="$emits llvm"
+else
+	echo "check: $CLANG not found, skipping llvm output"
+fi
+
+tmp=$(mktemp -d) || exit 2
+trap 'rm -rf "$tmp"' EXIT INT TERM
+
+fail=0
+
+for test in "$@"; do
+	flags=$(cat "tests/$test.flags" 2> /dev/null)
+	input=tests/$test.in
+	[ -f "$input" ] || input=/dev/null
+
+	for emit in $emits; do
+		cc=
+		[ "$emit" = llvm ] && cc="-x $CLANG"
+
+		rm -f "$tmp/prog"
+
+		if ! "$BFC" "tests/$test.bf" -o "$tmp/prog" -C "$BFC1" -e "$emit" $cc $flags ||
+				[ ! -x "$tmp/prog" ]; then
+			echo "check: $test: $emit: compile failed"
+			fail=1
+			continue
+		fi
+
+		if ! timeout 10 "$tmp/prog" < "$input" > "$tmp/out" || ! cmp -s "$tmp/out" "tests/$test.out"; then
+			echo "check: $test: $emit: wrong output"
+			fail=1
+		fi
+	done
+done
+
+ir=$tmp/prog.ir
+"$BFC1" tests/hello.bf "$ir" -e ir || { echo "check: ir: emit failed"; exit 1; }
+size=$(wc -c < "$ir")
+
+for i in $(seq 0 $((size - 1))); do
+	head -c "$i" "$ir" > "$tmp/cut.ir"
+	"$BFC1" "$tmp/cut.ir" "$tmp/cut.s" 2> "$tmp/err"
+	status=$?
+
+	# shorter than magic is loaded as brainfuck source
+	if [ $i -ge 5 ] && { [ $status -ne 1 ] || ! grep -q '^bfc1: ' "$tmp/err"; }; then
+		echo "check: ir: cut at $i: status $status"
+		fail=1
+	fi
+
+	{ head -c "$i" "$ir"; printf '\000'; tail -c +$((i + 2)) "$ir"; } > "$tmp/bad.ir"
+	"$BFC1" "$tmp/bad.ir" "$tmp/bad.s" 2> "$tmp/err"
+	status=$?
+
+	if [ $status -gt 1 ] || { [ $status -eq 1 ] && ! grep -q '^bfc1: ' "$tmp/err"; }; then
+		echo "check: ir: byte $i zeroed: status $status"
+		fail=1
+	fi
+done
+
+exit $fail